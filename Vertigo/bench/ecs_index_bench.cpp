@@ -0,0 +1,96 @@
+// Compares the two entity -> component lookups of tiny_ecs, SparseEntityIndex (the default) and HashEntityIndex,
+// through a ComponentContainer of each. Every size gets fresh entities, which are inserted, looked up and removed
+// in a shuffled order, the way the game touches them. Build it with the ecs_index_bench target and run it from
+// a release build.
+
+// stlib
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// internal
+#include "tiny_ecs.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// About the size of the game's small components
+struct Payload
+{
+	float value[4];
+};
+
+struct Timings
+{
+	double insert_ns;
+	double lookup_ns;
+	double remove_ns;
+};
+
+// Nanoseconds per call of fn(entity) over all entities
+template <typename Fn>
+static double time_per_entity(const std::vector<Entity>& entities, Fn fn)
+{
+	const auto start = Clock::now();
+	for (Entity entity : entities)
+		fn(entity);
+	const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+	return elapsed.count() / entities.size();
+}
+
+template <typename EntityIndex>
+static Timings run(const std::vector<Entity>& insert_order, const std::vector<Entity>& lookup_order, const std::vector<Entity>& remove_order)
+{
+	ComponentContainer<Payload, EntityIndex> container;
+	Timings timings;
+
+	timings.insert_ns = time_per_entity(insert_order, [&](Entity entity) {
+		container.insert(entity, Payload{ { (float)entity.index(), 0.f, 0.f, 0.f } });
+	});
+
+	// the sum keeps the lookups from being optimized away
+	float sum = 0.f;
+	timings.lookup_ns = time_per_entity(lookup_order, [&](Entity entity) {
+		sum += container.read(entity).value[0];
+	});
+	if (sum < 0.f)
+		printf("unreachable\n");
+
+	timings.remove_ns = time_per_entity(remove_order, [&](Entity entity) {
+		container.remove(entity);
+	});
+	return timings;
+}
+
+int main()
+{
+	std::mt19937 random(1234);
+	const size_t sizes[] = { 10000, 100000, 1000000 };
+
+	printf("%10s %-8s %12s %12s %12s\n", "entities", "index", "insert ns", "lookup ns", "remove ns");
+	for (size_t size : sizes)
+	{
+		std::vector<Entity> entities;
+		entities.reserve(size);
+		for (size_t i = 0; i < size; i++)
+			entities.push_back(Entity());
+
+		std::vector<Entity> insert_order = entities;
+		std::vector<Entity> lookup_order = entities;
+		std::vector<Entity> remove_order = entities;
+		std::shuffle(insert_order.begin(), insert_order.end(), random);
+		std::shuffle(lookup_order.begin(), lookup_order.end(), random);
+		std::shuffle(remove_order.begin(), remove_order.end(), random);
+
+		const Timings sparse = run<SparseEntityIndex>(insert_order, lookup_order, remove_order);
+		const Timings hash = run<HashEntityIndex>(insert_order, lookup_order, remove_order);
+		printf("%10zu %-8s %12.1f %12.1f %12.1f\n", size, "sparse", sparse.insert_ns, sparse.lookup_ns, sparse.remove_ns);
+		printf("%10zu %-8s %12.1f %12.1f %12.1f\n", size, "hash", hash.insert_ns, hash.lookup_ns, hash.remove_ns);
+
+		// the next size starts over, the pool has room for about a million entities
+		for (Entity entity : entities)
+			Entity::pool.release(entity);
+	}
+	return EXIT_SUCCESS;
+}
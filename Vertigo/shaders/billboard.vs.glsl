@@ -9,8 +9,14 @@ layout (location = 1) in vec3 in_color;
 out vec3 vcolor;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+// Camera of the current pass, shared by all programs (FrameUniforms in render_system.hpp)
+layout(std140) uniform Frame
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+	vec4 clusterScale;
+};
 uniform float scale;
 
 void main()
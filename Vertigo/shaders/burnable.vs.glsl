@@ -1,8 +1,8 @@
 #version 330
 
 // Input attributes
-in vec3 in_position;
-in vec3 in_color;
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_color;
 
 out vec3 vcolor;
 out vec2 vpos;
@@ -10,8 +10,14 @@ out vec2 vpos;
 // Inputs the matrices needed for 3D viewing with perspective
 uniform mat4 model;
 uniform mat4 translate;
-uniform mat4 view;
-uniform mat4 proj;
+// Camera of the current pass, shared by all programs (FrameUniforms in render_system.hpp)
+layout(std140) uniform Frame
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+	vec4 clusterScale;
+};
 
 void main()
 {
@@ -3,7 +3,7 @@
 // !!! Simple shader for colouring basic meshes
 
 // Input attributes
-in vec3 in_position;
+layout (location = 0) in vec3 in_position;
 
 // Application data
 uniform mat3 transform;
@@ -3,8 +3,10 @@
 // From vertex shader
 in vec2 texcoord;
 
-// Application data
-uniform sampler2D sampler0;
+// Application data: the texture is a layer of sampler0, or the frame of the cutscene if layer is -1
+uniform sampler2DArray sampler0;
+uniform sampler2D cutscene_frame;
+uniform int layer;
 uniform vec3 fcolor;
 
 // Output color
@@ -12,5 +14,8 @@ layout(location = 0) out  vec4 color;
 
 void main()
 {
-	color = vec4(fcolor, 1.0) * texture(sampler0, vec2(texcoord.x, texcoord.y));
+	if (layer < 0)
+		color = vec4(fcolor, 1.0) * texture(cutscene_frame, texcoord);
+	else
+		color = vec4(fcolor, 1.0) * texture(sampler0, vec3(texcoord, layer));
 }
@@ -14,34 +14,58 @@ struct DirLight {
     vec3 specular;
 };
 
+// The terms all point lights share, their positions are in lightPositions. The attenuation factors fill the
+// padding after the vec3s of the std140 layout.
 struct PointLight {
-    vec3 position;
-    
-    float constant;
-    float linear;
-    float quadratic;
-	
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
+    float range;
 };
 
-#define NR_POINT_LIGHTS 5
+// The cluster grid (light_clusters_x/y/z in light_clusters.hpp)
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 16
 
 // From Vertex Shader
 in vec3 vcolor;
-in vec3 fragPos; // Distance from local origin
+in vec3 fragPos;
 in vec3 normal;
+in float viewDepth;
+
+// Camera of the current pass, shared by all programs (FrameUniforms in render_system.hpp)
+layout(std140) uniform Frame
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+	vec4 clusterScale;
+};
+
+// Lights of the frame, shared by the lit programs (LightUniforms in render_system.hpp)
+layout(std140) uniform Lights
+{
+	DirLight dirLight;
+	PointLight pointLight;
+	int numLights;
+	int numDynamicLights;
+};
+
+// The point lights binned into the clusters of the screen and the view depth (see LightClusters)
+uniform samplerBuffer lightPositions;
+uniform usamplerBuffer lightClusters; // per cluster the offset of its lights in lightIndices and their count
+uniform usamplerBuffer lightIndices;
 
-uniform vec3 viewPos;
 uniform Material material;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform int numLights;
 uniform float alpha;
 uniform vec3 objColor;
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+uvec2 ClusterLights();
+vec3 CalcPointLight(PointLight light, vec3 position, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 // Output color
 layout(location = 0) out vec4 color;
@@ -65,24 +89,39 @@ void main()
 
 	vec3 result = ambient + diffuse + specular;
 
-    for(int i = 0; i < numLights; i++)
-        result += CalcPointLight(pointLights[i], norm, fragPos, viewDir);
+    // only the lights of the fragment's cluster can reach it
+    uvec2 cluster = ClusterLights();
+    for(uint i = 0u; i < cluster.y; i++) {
+        int light = int(texelFetch(lightIndices, int(cluster.x + i)).r);
+        result += CalcPointLight(pointLight, texelFetch(lightPositions, light).xyz, norm, fragPos, viewDir);
+    }
 
 	color = vec4(result, alpha);
 }
 
+// The offset and count of the lights of the fragment's cluster
+uvec2 ClusterLights()
+{
+    ivec3 cell = ivec3(gl_FragCoord.xy * clusterScale.xy, (viewDepth - clusterScale.w) * clusterScale.z);
+    cell = clamp(cell, ivec3(0), ivec3(CLUSTERS_X - 1, CLUSTERS_Y - 1, CLUSTERS_Z - 1));
+    return texelFetch(lightClusters, (cell.z * CLUSTERS_Y + cell.y) * CLUSTERS_X + cell.x).xy;
+}
+
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(PointLight light, vec3 position, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // attenuation
-    float distance = length(light.position - fragPos);
+    float distance = length(position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // fades out to nothing at the range, the clusters leave out the lights farther away
+    float fade = clamp(1.0 - pow(distance / light.range, 4.0), 0.0, 1.0);
+    attenuation *= fade * fade;
     // combine results
     vec3 ambient = light.ambient * vcolor;
     vec3 diffuse = light.diffuse * diff * vcolor;
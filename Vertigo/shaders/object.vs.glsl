@@ -1,26 +1,35 @@
 #version 330
 
 // Input attributes
-in vec3 in_position;
-in vec3 in_color;
-in vec3 in_normal;
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_color;
+layout (location = 2) in vec3 in_normal;
 
 out vec3 vcolor;
 out vec3 fragPos;
 out vec3 normal;
+out float viewDepth; // for the light clusters
 
 // Inputs the matrices needed for 3D viewing with perspective
 uniform mat4 model;
 uniform mat4 translate;
 uniform mat4 scale;
-uniform mat4 view;
-uniform mat4 proj;
+// Camera of the current pass, shared by all programs (FrameUniforms in render_system.hpp)
+layout(std140) uniform Frame
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+	vec4 clusterScale;
+};
 uniform vec3 objColor;
 
 void main()
 {
 	mat4 trueModel = translate * model * scale;
-	fragPos = in_position; // local coordinated before transform
+	// the point lights are in world space, so are the fragments
+	fragPos = vec3(trueModel * vec4(in_position, 1.0));
+	viewDepth = -(view * vec4(fragPos, 1.0)).z;
 	vcolor = in_color;
 	normal = mat3(transpose(inverse(trueModel))) * in_normal;
 	gl_Position = proj * view * trueModel * vec4(in_position.xyz, 1.0);
@@ -7,15 +7,16 @@ out vec4 FragColor;
 in vec2 texCoord;
 uniform vec3 fcolor;
 
-// Gets the Texture Unit from the main function
-uniform sampler2D tex0;
+// Gets the Texture Unit from the main function, the texture is a layer of the array
+uniform sampler2DArray tex0;
+uniform int layer;
 
 void main()
 {
-	vec4 texColor = texture(tex0, texCoord);
+	vec4 texColor = texture(tex0, vec3(texCoord, layer));
 	if (texColor.a < 0.1) {
 		discard;
 	}
 
-	FragColor = texture(tex0, texCoord);
+	FragColor = texture(tex0, vec3(texCoord, layer));
 }
\ No newline at end of file
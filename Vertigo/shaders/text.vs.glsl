@@ -13,8 +13,14 @@ uniform float scale;
 
 // Inputs the matrices needed for 3D viewing with perspective
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+// Camera of the current pass, shared by all programs (FrameUniforms in render_system.hpp)
+layout(std140) uniform Frame
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+	vec4 clusterScale;
+};
 
 void main()
 {
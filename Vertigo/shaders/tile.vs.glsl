@@ -7,32 +7,48 @@ layout (location = 1) in vec2 aTex;
 // Normal
 layout (location = 2) in vec3 aNormal;
 
+// Per tile (TileInstance in render_system.hpp)
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in vec3 instanceColor;
+// highlighted, length of the animation sheet, frame of the animation, texture layer
+layout (location = 8) in ivec4 instanceFlags;
+// light of the static lights at the four vertices of the quad, baked when the tile is built
+layout (location = 9) in mat4x3 instanceLight;
+
 // Outputs the texture coordinates to the fragment shader
 out vec3 fragPos;
 out vec2 texCoord;
 out vec3 normal;
+flat out int highlighted;
+flat out int layer;
+flat out vec3 color;
+out vec3 bakedLight;
+out float viewDepth;
 
-// Inputs the matrices needed for 3D viewing with perspective
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
-
-// Flag for animations
-uniform bool animated = false;
-uniform int sheet_length = 1;
-uniform int index = 0;
+// Rotation of the whole cube (the turn to another face and the trackball), the same for all tiles
+uniform mat4 cube_rotation;
+// Camera of the current pass, shared by all programs (FrameUniforms in render_system.hpp)
+layout(std140) uniform Frame
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+	vec4 clusterScale;
+};
 
 void main()
 {
+	mat4 model = cube_rotation * instanceModel;
 	// Outputs the positions/coordinates of all vertices
 	gl_Position = proj * view * model * vec4(aPos, 1.0);
 	fragPos = vec3(model * vec4(aPos, 1.0));
-	// Assigns the texture coordinates from the Vertex Data to "texCoord"
-	if (animated) {
-		texCoord = vec2((aTex.x + index)/ sheet_length, aTex.y);
-	}
-	else {
-		texCoord = vec2(aTex.x, aTex.y);
-	}
+	viewDepth = -(view * vec4(fragPos, 1.0)).z;
+	// Assigns the texture coordinates from the Vertex Data to "texCoord", a frame of the sheet if animated
+	texCoord = vec2((aTex.x + instanceFlags.z) / instanceFlags.y, aTex.y);
 	normal = mat3(transpose(inverse(model))) * aNormal;
+	highlighted = instanceFlags.x;
+	layer = instanceFlags.w;
+	color = instanceColor;
+	// the quad is drawn indexed, gl_VertexID is the vertex of the quad
+	bakedLight = instanceLight[gl_VertexID];
 }
\ No newline at end of file
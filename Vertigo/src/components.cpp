@@ -5,6 +5,7 @@
 #include "../ext/stb_image/stb_image.h"
 
 // stlib
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -216,6 +217,11 @@ bool Cube::loadFromExcelFile(std::string filename) {
 	size = stoi(sizeStr);
 	float distance = size / 2.f;
 
+	// One block for all tiles of the level, sized for the largest of the tile types created below
+	const size_t largest_tile = std::max({ sizeof(Tile), sizeof(SwitchTile), sizeof(ThrowTile), sizeof(UpTile),
+		sizeof(InvisibleTile), sizeof(ControlTile), sizeof(ConstMovingTile), sizeof(ButtonTile), sizeof(BurnableTile) });
+	tile_memory = std::make_shared<TileArena>(6 * size * size * largest_tile);
+
 	float divisor = 1.f;
 
 	switch (size) {
@@ -252,7 +258,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 				switch (static_cast<TileState>(value[0] - 'A')) {
 					case TileState::W:
 					{
-						SwitchTile* s_tile = new SwitchTile();
+						SwitchTile* s_tile = tile_memory->create<SwitchTile>();
 						s_tile->model = tileStartingMatrix(i, x, y, distance);
 						s_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -263,7 +269,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::T:
 					{
-						ThrowTile* s_tile = new ThrowTile();
+						ThrowTile* s_tile = tile_memory->create<ThrowTile>();
 						s_tile->model = tileStartingMatrix(i, x, y, distance);
 						s_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -274,7 +280,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::U:
 					{
-						UpTile* u_tile = new UpTile();
+						UpTile* u_tile = tile_memory->create<UpTile>();
 						u_tile->model = tileStartingMatrix(i, x, y, distance);
 						u_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -286,7 +292,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::R:
 					{
-						UpTile* u_tile = new UpTile();
+						UpTile* u_tile = tile_memory->create<UpTile>();
 						u_tile->model = tileStartingMatrix(i, x, y, distance);
 						u_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -298,7 +304,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::D:
 					{
-						UpTile* u_tile = new UpTile();
+						UpTile* u_tile = tile_memory->create<UpTile>();
 						u_tile->model = tileStartingMatrix(i, x, y, distance);
 						u_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -310,7 +316,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::L:
 					{
-						UpTile* u_tile = new UpTile();
+						UpTile* u_tile = tile_memory->create<UpTile>();
 						u_tile->model = tileStartingMatrix(i, x, y, distance);
 						u_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -322,7 +328,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::I:
 					{
-						InvisibleTile* i_tile = new InvisibleTile();
+						InvisibleTile* i_tile = tile_memory->create<InvisibleTile>();
 						i_tile->model = tileStartingMatrix(i, x, y, distance);
 						i_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -333,7 +339,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::C:
 					{
-						ControlTile* c_tile = new ControlTile();
+						ControlTile* c_tile = tile_memory->create<ControlTile>();
 						c_tile->model = tileStartingMatrix(i, x, y, distance);
 						c_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -344,7 +350,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					case TileState::O:
 					{
-						ConstMovingTile* c_tile = new ConstMovingTile();
+						ConstMovingTile* c_tile = tile_memory->create<ConstMovingTile>();
 						c_tile->model = tileStartingMatrix(i, x, y, distance);
 						c_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -353,9 +359,21 @@ bool Cube::loadFromExcelFile(std::string filename) {
 						c_tile->direction = static_cast<FACE_DIRECTION>(i);
 						break;
 					}
+					case TileState::B:
+					{
+						// the world keeps the burnable object in it, see load_level
+						BurnableTile* b_tile = tile_memory->create<BurnableTile>();
+						b_tile->model = tileStartingMatrix(i, x, y, distance);
+						b_tile->tileState = TileState::B;
+
+						row.push_back(b_tile);
+						b_tile->coords = { i, y_coord, x_coord };
+						b_tile->direction = static_cast<FACE_DIRECTION>(i);
+						break;
+					}
 					case TileState::G:
 					{
-						ButtonTile* c_tile = new ButtonTile();
+						ButtonTile* c_tile = tile_memory->create<ButtonTile>();
 						c_tile->model = tileStartingMatrix(i, x, y, distance);
 						c_tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -366,7 +384,7 @@ bool Cube::loadFromExcelFile(std::string filename) {
 					}
 					default:
 					{
-						Tile* tile = new Tile();
+						Tile* tile = tile_memory->create<Tile>();
 						tile->model = tileStartingMatrix(i, x, y, distance);
 						tile->tileState = static_cast<TileState>(value[0] - 'A');
 
@@ -426,6 +444,7 @@ bool Cube::loadTextFromExcelFile(std::string filename) {
 		Text t;
 		t.model = textStartingMatrix(i, x, y, distance, scale_x, scale_y);
 		t.texture_id = std::stoi(textValues[5]);
+		t.face = i;
 		this->text.push_back(t);
 
 		std::vector<std::string>().swap(textValues);
@@ -567,12 +586,135 @@ bool Cube::loadModificationsFromExcelFile(std::string filename) {
 void Cube::reset() {
 	std::array<std::vector<std::vector<Tile*>>, 6>().swap(this->faces);
 	std::vector<Text>().swap(this->text);
+	tile_memory.reset();
 }
 
 Tile* Cube::getTile(Coordinates coord) {
 	return this->faces[coord.f][coord.r][coord.c];
 }
 
+void Cube::save_tiles(std::vector<char>& out) const {
+	for (const auto& face : faces)
+		for (const auto& row : face)
+			for (const Tile* tile : row)
+				tile->save_state(out);
+}
+
+void Cube::load_tiles(const char*& in) {
+	for (auto& face : faces)
+		for (auto& row : face)
+			for (Tile* tile : row)
+				tile->load_state(in);
+}
+
+void Tile::save_state(std::vector<char>& out) const {
+	snapshot_write(out, direction);
+	snapshot_write(out, model);
+	snapshot_write(out, coords);
+	snapshot_write(out, tileState);
+	snapshot_write(out, highlighted);
+	snapshot_write(out, popup);
+	snapshot_write(out, color);
+}
+
+void Tile::load_state(const char*& in) {
+	snapshot_read(in, direction);
+	snapshot_read(in, model);
+	snapshot_read(in, coords);
+	snapshot_read(in, tileState);
+	snapshot_read(in, highlighted);
+	snapshot_read(in, popup);
+	snapshot_read(in, color);
+}
+
+void ControlTile::save_state(std::vector<char>& out) const {
+	Tile::save_state(out);
+	snapshot_write(out, controled);
+}
+
+void ControlTile::load_state(const char*& in) {
+	Tile::load_state(in);
+	snapshot_read(in, controled);
+}
+
+void UpTile::save_state(std::vector<char>& out) const {
+	Tile::save_state(out);
+	snapshot_write(out, dir);
+	snapshot_write(out, id);
+}
+
+void UpTile::load_state(const char*& in) {
+	Tile::load_state(in);
+	snapshot_read(in, dir);
+	snapshot_read(in, id);
+}
+
+void SwitchTile::save_state(std::vector<char>& out) const {
+	Tile::save_state(out);
+	snapshot_write(out, targetTile);
+	snapshot_write(out, targetTileState);
+	snapshot_write(out, targetCoords);
+	snapshot_write(out, device);
+	snapshot_write(out, toggled);
+	snapshot_write(out, diff);
+}
+
+void SwitchTile::load_state(const char*& in) {
+	Tile::load_state(in);
+	snapshot_read(in, targetTile);
+	snapshot_read(in, targetTileState);
+	snapshot_read(in, targetCoords);
+	snapshot_read(in, device);
+	snapshot_read(in, toggled);
+	snapshot_read(in, diff);
+}
+
+void InvisibleTile::save_state(std::vector<char>& out) const {
+	Tile::save_state(out);
+	snapshot_write(out, toggled);
+}
+
+void InvisibleTile::load_state(const char*& in) {
+	Tile::load_state(in);
+	snapshot_read(in, toggled);
+}
+
+void ConstMovingTile::save_state(std::vector<char>& out) const {
+	SwitchTile::save_state(out);
+	snapshot_write(out, startCoords);
+	snapshot_write(out, endCoords);
+}
+
+void ConstMovingTile::load_state(const char*& in) {
+	SwitchTile::load_state(in);
+	snapshot_read(in, startCoords);
+	snapshot_read(in, endCoords);
+}
+
+void ButtonTile::save_state(std::vector<char>& out) const {
+	Tile::save_state(out);
+	snapshot_write(out, button_id);
+	snapshot_write(out, activated);
+}
+
+void ButtonTile::load_state(const char*& in) {
+	Tile::load_state(in);
+	snapshot_read(in, button_id);
+	snapshot_read(in, activated);
+}
+
+void BurnableTile::save_state(std::vector<char>& out) const {
+	Tile::save_state(out);
+	snapshot_write(out, burned);
+	snapshot_write(out, object);
+}
+
+void BurnableTile::load_state(const char*& in) {
+	Tile::load_state(in);
+	snapshot_read(in, burned);
+	snapshot_read(in, object);
+}
+
 // Very, VERY simple OBJ loader from https://github.com/opengl-tutorials/ogl tutorial 7
 // (modified to also read vertex color and omit uv and normals)
 bool Mesh::loadFromOBJFile(std::string obj_path, std::vector<ColoredVertex>& out_vertices, std::vector<uint16_t>& out_vertex_indices, vec2& out_size)
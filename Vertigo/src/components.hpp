@@ -4,6 +4,8 @@
 #include <array>
 #include <unordered_map>
 #include <utility>
+#include <memory>
+#include <type_traits>
 #include "../ext/stb_image/stb_image.h"
 
 struct Coordinates
@@ -120,21 +122,29 @@ struct Tile
 	glm::mat4 model;
 	Coordinates coords;
 	TileState tileState = TileState::E;
-	std::unordered_map<int, std::pair<Coordinates, int>> adjList; // map of direction to Coordinates and direction to add
+	std::array<std::pair<Coordinates, int>, 4> adjList{}; // per direction the Coordinates and direction to add, only set at the edges
 	bool highlighted = false;
 	bool popup = false;
 	int color = -1;
 	virtual void action() { return; };
+
+	// The state for level snapshots, see Cube::save_tiles. The adjacency list is left out, it doesn't change after loading.
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct ControlTile : public Tile {
 	bool controled = 0; // 0 is not controlled, 1 is controlled
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct UpTile : public Tile {
 	Direction dir;
 	int id;
 	virtual void action();
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct SwitchTile : public Tile {
@@ -146,29 +156,39 @@ struct SwitchTile : public Tile {
 	bool toggled = false;
 	int diff = 0; // to compensate for move tiles being on a different face
 	virtual void action();
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct InvisibleTile : public Tile {
 	bool toggled = false;
 	virtual void action();
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct ConstMovingTile : public SwitchTile {
 	Coordinates startCoords;
 	Coordinates endCoords;
 	virtual void action();
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct ButtonTile : public Tile {
 	int button_id = 0;
 	bool activated = true;
 	virtual void action();
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct BurnableTile : public Tile {
 	bool burned = false;
 	Entity object;
 	virtual void action();
+	virtual void save_state(std::vector<char>& out) const;
+	virtual void load_state(const char*& in);
 };
 
 struct ThrowTile : public SwitchTile {
@@ -179,6 +199,36 @@ struct Text
 {
 	glm::mat4 model;
 	int texture_id;
+	int face = 0; // of the cube, the renderer skips text on faces turned away
+};
+
+// Memory for the tiles of one level. The tiles are placed one after the other in large blocks, which are all
+// released at once with the arena, instead of a few hundred separate heap allocations per level.
+class TileArena
+{
+	std::vector<std::unique_ptr<char[]>> blocks;
+	size_t block_size;
+	size_t used; // bytes used in the last block
+public:
+	explicit TileArena(size_t block_size) : block_size(block_size), used(block_size) {}
+	TileArena(const TileArena&) = delete;
+	TileArena& operator=(const TileArena&) = delete;
+
+	template <typename T>
+	T* create()
+	{
+		// nothing is destroyed one by one, the memory just goes away with the arena
+		static_assert(std::is_base_of<Tile, T>::value && std::is_trivially_destructible<T>::value, "The arena only holds tiles without destructors");
+		size_t offset = (used + alignof(T) - 1) & ~(alignof(T) - 1);
+		if (offset + sizeof(T) > block_size)
+		{
+			block_size = std::max(block_size, sizeof(T));
+			blocks.emplace_back(new char[block_size]);
+			offset = 0;
+		}
+		used = offset + sizeof(T);
+		return new (blocks.back().get() + offset) T();
+	}
 };
 
 // represents the entire cube
@@ -192,8 +242,13 @@ struct Cube
 	std::array<std::vector<std::vector<Tile*>>, 6> faces;
 	std::vector<Text> text;
 	int size = 0;
+	std::shared_ptr<TileArena> tile_memory; // the faces' tiles, shared with copies of the cube such as the renderer's
 	Tile* getTile(Coordinates coord);
 	void reset();
+
+	// Saves the state of all tiles of a loaded level, load_tiles() writes it back into the same tiles
+	void save_tiles(std::vector<char>& out) const;
+	void load_tiles(const char*& in);
 };
 
 
@@ -224,12 +279,94 @@ struct Motion
 	float remaining_time = 0; // Used if interpolating
 };
 
-// Stucture to store collision information
-struct Collision
+// Motion is stored as structure of arrays, see MotionFields. get() and views hand out a MotionRef, which has a
+// reference for every member of Motion, so motion.position.x = ... works as before. Copying a MotionRef into a
+// Motion takes a snapshot.
+struct MotionRef
 {
-	// Note, the first object is stored in the ECS container.entities
+	bool& interpolate;
+	bool& move_z;
+	vec3& position;
+	vec3& scale;
+	float& rotation;
+	vec3& velocity;
+	vec3& acceleration;
+	vec3& destination;
+	float& remaining_time;
+
+	operator Motion() const
+	{
+		Motion m;
+		m.interpolate = interpolate;
+		m.move_z = move_z;
+		m.position = position;
+		m.scale = scale;
+		m.rotation = rotation;
+		m.velocity = velocity;
+		m.acceleration = acceleration;
+		m.destination = destination;
+		m.remaining_time = remaining_time;
+		return m;
+	}
+};
+
+// The field arrays of the Motion storage, one per member
+struct MotionFields
+{
+	typedef Motion Component;
+	typedef MotionRef Ref;
+
+	AlignedArray<bool> interpolate;
+	AlignedArray<bool> move_z;
+	AlignedArray<vec3> position;
+	AlignedArray<vec3> scale;
+	AlignedArray<float> rotation;
+	AlignedArray<vec3> velocity;
+	AlignedArray<vec3> acceleration;
+	AlignedArray<vec3> destination;
+	AlignedArray<float> remaining_time;
+
+	template <class Fn>
+	void for_each_field(Fn fn)
+	{
+		fn(interpolate); fn(move_z); fn(position); fn(scale); fn(rotation);
+		fn(velocity); fn(acceleration); fn(destination); fn(remaining_time);
+	}
+
+	MotionRef at(unsigned int i)
+	{
+		return MotionRef{ interpolate[i], move_z[i], position[i], scale[i], rotation[i],
+			velocity[i], acceleration[i], destination[i], remaining_time[i] };
+	}
+	Motion load(unsigned int i) const
+	{
+		return const_cast<MotionFields&>(*this).at(i);
+	}
+	void push_back(const Motion& m)
+	{
+		interpolate.push_back(m.interpolate);
+		move_z.push_back(m.move_z);
+		position.push_back(m.position);
+		scale.push_back(m.scale);
+		rotation.push_back(m.rotation);
+		velocity.push_back(m.velocity);
+		acceleration.push_back(m.acceleration);
+		destination.push_back(m.destination);
+		remaining_time.push_back(m.remaining_time);
+	}
+};
+template <>
+struct ComponentStorageFor<Motion> { typedef SoAContainer<MotionFields> type; };
+
+// Sent by the physics when two entities collide, see ECSRegistry::collision_events
+struct CollisionEvent
+{
+	Entity first; // the fire
 	Entity other; // the second object involved in the collision
-	Collision(Entity& other) { this->other = other; };
+	bool operator<(const CollisionEvent& e) const
+	{
+		return unsigned(first) != unsigned(e.first) ? unsigned(first) < unsigned(e.first) : unsigned(other) < unsigned(e.other);
+	}
 };
 
 // Sets the brightness of the screen
@@ -331,6 +468,7 @@ struct Enemy
 struct Billboard
 {
 	glm::mat4 model = glm::mat4(1.f);
+	int face = 0; // of the cube, the renderer skips billboards on faces turned away
 };
 
 struct LightSource
@@ -352,6 +490,14 @@ struct TrackBallInfo
 	quat rotation = quat(1,0,0,0);
 };
 
+// The root of everything on the cube (tiles, text, objects, billboards). While the cube turns to another face the
+// models stay put and only the root rotates, the quarter turn is baked into the models once it is done. The
+// renderer puts the root and the trackball in front of the models.
+struct CubeRoot
+{
+	quat animation = quat(1,0,0,0);
+};
+
 /**
  * The following enumerators represent global identifiers refering to graphic
  * assets. For example TEXTURE_ASSET_ID are the identifiers of each texture
@@ -0,0 +1,112 @@
+#pragma once
+
+// stlib
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <assert.h>
+
+// A typed queue for events that systems send each other, e.g. the collisions found by the physics.
+// Events go into one of two fixed size buffers used as a ring: push() writes the current frame's buffer while
+// the events of the last frame, published by swap(), are read from the other one. Pushing is lock free and
+// may happen on several threads at once, reading can go on concurrently with the pushes of the next frame.
+// With Deduplicate, swap() drops repeated events (keeping the first one), which needs Event::operator<.
+template <typename Event, bool Deduplicate = false>
+class EventChannel
+{
+	static_assert(std::is_trivially_copyable<Event>::value, "Events are copied into preallocated slots");
+
+	typedef typename std::aligned_storage<sizeof(Event), alignof(Event)>::type Slot;
+
+	struct Buffer
+	{
+		std::unique_ptr<Slot[]> slots;
+		std::atomic<size_t> count{ 0 }; // slots claimed by push(), may exceed the capacity when events were dropped
+	};
+
+	size_t capacity;
+	std::array<Buffer, 2> buffers;
+	unsigned int write_buffer = 0;
+	size_t readable = 0; // events in the read buffer
+	std::atomic<size_t> dropped_events{ 0 };
+	// Scratch space of the de-duplication
+	std::vector<unsigned int> order;
+	std::vector<unsigned char> keep;
+
+	Event* events(unsigned int buffer) { return reinterpret_cast<Event*>(buffers[buffer].slots.get()); }
+	const Event* events(unsigned int buffer) const { return reinterpret_cast<const Event*>(buffers[buffer].slots.get()); }
+
+	size_t deduplicate(Event* begin, size_t count, std::false_type) { (void)begin; return count; }
+	size_t deduplicate(Event* begin, size_t count, std::true_type)
+	{
+		// Sort positions so that the order of the first occurrences survives
+		order.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return begin[a] < begin[b]; });
+		keep.assign(count, 1);
+		for (size_t i = 1; i < count; i++)
+			if (!(begin[order[i - 1]] < begin[order[i]]))
+				keep[order[i]] = 0;
+		size_t kept = 0;
+		for (size_t i = 0; i < count; i++)
+			if (keep[i])
+				begin[kept++] = begin[i];
+		return kept;
+	}
+
+public:
+	explicit EventChannel(size_t capacity = 1024) : capacity(capacity)
+	{
+		for (Buffer& buffer : buffers)
+			buffer.slots.reset(new Slot[capacity]);
+	}
+	EventChannel(const EventChannel&) = delete;
+	EventChannel& operator=(const EventChannel&) = delete;
+
+	// Queues e for the next swap(), returns false and counts it as dropped if this frame's buffer is full
+	bool push(const Event& e)
+	{
+		Buffer& buffer = buffers[write_buffer];
+		const size_t slot = buffer.count.fetch_add(1, std::memory_order_relaxed);
+		if (slot >= capacity)
+		{
+			dropped_events.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		new (&buffer.slots[slot]) Event(e);
+		return true;
+	}
+
+	// Publishes the events pushed since the last swap and empties the buffer of the ones published before.
+	// This is the frame's sync point for the channel: no push() may be in flight while it runs.
+	void swap()
+	{
+		const unsigned int read_buffer = write_buffer;
+		write_buffer ^= 1;
+		buffers[write_buffer].count.store(0, std::memory_order_relaxed);
+		readable = std::min(buffers[read_buffer].count.load(std::memory_order_relaxed), capacity);
+		readable = deduplicate(events(read_buffer), readable, std::integral_constant<bool, Deduplicate>());
+	}
+
+	// The events published by the last swap()
+	const Event* begin() const { return events(write_buffer ^ 1); }
+	const Event* end() const { return begin() + readable; }
+	size_t size() const { return readable; }
+	bool empty() const { return readable == 0; }
+
+	// Drops everything, pushed or published
+	void clear()
+	{
+		for (Buffer& buffer : buffers)
+			buffer.count.store(0, std::memory_order_relaxed);
+		readable = 0;
+	}
+
+	// Events that didn't fit since the channel was created
+	size_t dropped() const { return dropped_events.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,98 @@
+// internal
+#include "light_clusters.hpp"
+
+// stlib
+#include <algorithm>
+#include <limits>
+
+// Cell of a coordinate in [-1, 1] (NDC) on an axis with the given number of cells, as the fragment at that
+// coordinate computes it from gl_FragCoord
+static int cellOf(float ndc, int cells)
+{
+	return std::min(std::max((int)floor((ndc * 0.5f + 0.5f) * cells), 0), cells - 1);
+}
+
+void LightClusters::build(const std::vector<vec3>& lights, float radius, const mat4& view, const mat4& projection, vec2 viewport)
+{
+	cluster_lights.assign(light_cluster_count, glm::uvec2(0));
+	light_indices.clear();
+	light_cells.clear();
+
+	// the slices span the view depths the lights reach, fragments in front or behind them are clamped to the
+	// first and last slice
+	float near = std::numeric_limits<float>::max();
+	float far = std::numeric_limits<float>::lowest();
+	for (vec3 light : lights)
+	{
+		const float depth = -(view * vec4(light, 1.f)).z;
+		near = std::min(near, depth - radius);
+		far = std::max(far, depth + radius);
+	}
+	if (lights.empty())
+		near = far = 0.f;
+	grid_scale = vec4(light_clusters_x / viewport.x, light_clusters_y / viewport.y,
+		light_clusters_z / std::max(far - near, 1e-3f), near);
+
+	// The cells of the box around every light. On the screen it is the bounds of the box's corners, the
+	// whole screen if one of them is behind a perspective camera.
+	for (vec3 light : lights)
+	{
+		const vec3 center = vec3(view * vec4(light, 1.f));
+		vec2 ndc_min = vec2(std::numeric_limits<float>::max());
+		vec2 ndc_max = vec2(std::numeric_limits<float>::lowest());
+		bool behind = false;
+		for (int corner = 0; corner < 8 && !behind; corner++)
+		{
+			const vec3 offset = vec3(corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius);
+			const vec4 clip = projection * vec4(center + offset, 1.f);
+			behind = clip.w <= 0.f;
+			const vec2 ndc = vec2(clip) / clip.w;
+			ndc_min = min(ndc_min, ndc);
+			ndc_max = max(ndc_max, ndc);
+		}
+		if (behind)
+		{
+			ndc_min = vec2(-1.f);
+			ndc_max = vec2(1.f);
+		}
+
+		Cells cells = { glm::ivec3(0), glm::ivec3(-1) };
+		if (ndc_max.x >= -1.f && ndc_min.x <= 1.f && ndc_max.y >= -1.f && ndc_min.y <= 1.f)
+		{
+			const float depth = -center.z;
+			const int slice_min = (int)((depth - radius - near) * grid_scale.z);
+			const int slice_max = (int)((depth + radius - near) * grid_scale.z);
+			cells.min = glm::ivec3(cellOf(ndc_min.x, light_clusters_x), cellOf(ndc_min.y, light_clusters_y),
+				std::min(std::max(slice_min, 0), light_clusters_z - 1));
+			cells.max = glm::ivec3(cellOf(ndc_max.x, light_clusters_x), cellOf(ndc_max.y, light_clusters_y),
+				std::min(std::max(slice_max, 0), light_clusters_z - 1));
+		}
+		light_cells.push_back(cells);
+	}
+
+	// Counting sort of the lights into the clusters: count, turn the counts into offsets, then fill in the
+	// lights in order
+	auto for_each_cluster = [](const Cells& cells, auto fn) {
+		for (int z = cells.min.z; z <= cells.max.z; z++)
+			for (int y = cells.min.y; y <= cells.max.y; y++)
+				for (int x = cells.min.x; x <= cells.max.x; x++)
+					fn((z * light_clusters_y + y) * light_clusters_x + x);
+	};
+	for (const Cells& cells : light_cells)
+		for_each_cluster(cells, [&](int cluster) { cluster_lights[cluster].y++; });
+
+	unsigned int offset = 0;
+	for (glm::uvec2& cluster : cluster_lights)
+	{
+		cluster.x = offset;
+		offset += cluster.y;
+		cluster.y = 0;
+	}
+	light_indices.resize(offset);
+
+	for (unsigned int light = 0; light < light_cells.size(); light++)
+		for_each_cluster(light_cells[light], [&](int cluster) {
+			glm::uvec2& lights_of_cluster = cluster_lights[cluster];
+			light_indices[lights_of_cluster.x + lights_of_cluster.y++] = light;
+		});
+}
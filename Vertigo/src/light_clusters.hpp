@@ -0,0 +1,42 @@
+#pragma once
+
+// stlib
+#include <vector>
+
+#include "common.hpp"
+
+// Size of the cluster grid: cells of the screen times slices of the view depth. Has to match CLUSTERS_X,
+// CLUSTERS_Y and CLUSTERS_Z of the lit shaders.
+const int light_clusters_x = 16;
+const int light_clusters_y = 9;
+const int light_clusters_z = 16;
+const int light_cluster_count = light_clusters_x * light_clusters_y * light_clusters_z;
+
+// Point lights binned into clusters, the cells of a grid over the screen and the view depth. A fragment only
+// evaluates the lights of its cluster, so its cost depends on the lights that reach it and not on how many
+// there are. Rebuilt on the CPU for every camera.
+class LightClusters
+{
+public:
+	// Bins the lights, spheres of the given radius, for the camera. viewport is the size of the framebuffer.
+	void build(const std::vector<vec3>& lights, float radius, const mat4& view, const mat4& projection, vec2 viewport);
+
+	// Per cluster the offset of its lights in indices() and their count. Cell (x, y, z) is cluster
+	// (z * light_clusters_y + y) * light_clusters_x + x.
+	const std::vector<glm::uvec2>& clusters() const { return cluster_lights; }
+	// The lights of all clusters, those of a cluster in increasing order
+	const std::vector<unsigned int>& indices() const { return light_indices; }
+	// From a fragment to its cell: x and y are cells per pixel, the slice is (view depth - w) * z
+	vec4 scale() const { return grid_scale; }
+
+private:
+	struct Cells
+	{
+		glm::ivec3 min;
+		glm::ivec3 max;
+	};
+	std::vector<Cells> light_cells; // of every light, empty if it is off screen
+	std::vector<glm::uvec2> cluster_lights;
+	std::vector<unsigned int> light_indices;
+	vec4 grid_scale = vec4(0.f);
+};
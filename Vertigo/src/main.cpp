@@ -3,12 +3,16 @@
 #include <gl3w.h>
 
 // stlib
+#include <algorithm>
 #include <chrono>
+#include <thread>
 
 // internal
 #include "ai_system.hpp"
 #include "physics_system.hpp"
 #include "render_system.hpp"
+#include "system_scheduler.hpp"
+#include "thread_pool.hpp"
 #include "world_system.hpp"
 
 using Clock = std::chrono::high_resolution_clock;
@@ -32,9 +36,37 @@ int main()
 	}
 
 	// initialize the main systems
-	renderer.init(window);
+	if (!renderer.init(window)) {
+		printf("Press any key to exit");
+		getchar();
+		return EXIT_FAILURE;
+	}
 	world.init(&renderer);
 
+	// The main thread takes part in running the systems, so one worker less than there are cores
+	ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	SystemScheduler scheduler(pool);
+	// the per entity loops of the systems split their containers over the same workers
+	ContainerInterface::workers = &pool;
+
+	// Systems in frame order, conflicting ones run in this order and the rest concurrently, see SystemScheduler.
+	// The world, the AI and the collision handling share game state outside of the registry and run alone, on the main thread
+	// since the world calls into GLFW and the audio.
+	// Hold timers, oscillations and integration all write Motion (integration every entity's position), so they
+	// are a chain as well, and the fire collisions read Motion and Object after them. The only systems that
+	// overlap are the enemy interpolation and that chain. Most of the parallelism is within the systems, whose
+	// per entity loops split their containers over the workers.
+	// hold_timers only runs after a step that went through (see hold_timers_due), which is safe to read because
+	// the world runs alone and before it.
+	scheduler.add("world", SystemAccess::everything(), [&](float elapsed_ms) { world.step(elapsed_ms); });
+	scheduler.add("ai", SystemAccess::everything(), [&](float) { ai.step(); });
+	scheduler.add("hold_timers", SystemAccess().write<HoldTimer, Motion>(), [&](float elapsed_ms) { world.update_hold_timers(elapsed_ms); });
+	scheduler.add("oscillate", SystemAccess().write<Oscillate, Motion>(), [&](float elapsed_ms) { physics.oscillate(elapsed_ms); });
+	scheduler.add("integrate", SystemAccess().write<Motion>(), [&](float elapsed_ms) { physics.integrate(elapsed_ms); });
+	scheduler.add("enemy_interpolation", SystemAccess().write<Enemy, Object>(), [&](float elapsed_ms) { physics.interpolate_enemies(elapsed_ms); });
+	scheduler.add("fire_collisions", SystemAccess().read<Fire, Object, Motion, Tile*>(), [&](float) { physics.collide_fire(); });
+	scheduler.add("collisions", SystemAccess::everything(), [&](float) { world.handle_collisions(); });
+
 	// variable timestep loop
 	auto t = Clock::now();
 	while (!world.is_over()) {
@@ -47,10 +79,10 @@ int main()
 			(float)(std::chrono::duration_cast<std::chrono::microseconds>(now - t)).count() / 1000;
 		t = now;
 
-		world.step(elapsed_ms);
-		ai.step();
-		physics.step(elapsed_ms);
-		world.handle_collisions();
+		scheduler.reporting = world.report_system_timings;
+		scheduler.run(elapsed_ms);
+		// Structural changes recorded by the systems above are applied here, before anything is drawn
+		registry.commands.flush();
 
 		renderer.draw();
 	}
@@ -35,55 +35,68 @@ bool collides(mat4 model1, mat4 model2)
 
 void PhysicsSystem::oscillate(float elapsed_ms)
 {
-	auto& oscillate_registry = registry.oscillations;
-	for (uint i = 0; i < oscillate_registry.size(); i++)
-	{
-		Oscillate& oscillate = oscillate_registry.components[i];
-		Entity e = oscillate_registry.entities[i];
-		Motion& motion = registry.motions.get(e);
+	// Each entity only writes its own Oscillate and Motion, so the oscillations can be split across the workers
+	auto& motions = registry.motions;
+	registry.oscillations.parallel_for_each([&](Entity entity, Oscillate& oscillate) {
+		const uint cID = motions.index_of(entity);
+		if (cID == ContainerInterface::npos)
+			return;
 		oscillate.phase += 2 * PI  * elapsed_ms / oscillate.period;
 		oscillate.phase = fmod(oscillate.phase, 2 * PI);
-		motion.position = oscillate.center + oscillate.amplitude * vec3(sin(oscillate.phase));
-		
-	}
+		motions.position[cID] = oscillate.center + oscillate.amplitude * vec3(sin(oscillate.phase));
+		motions.mark_dirty_at(cID);
+	}, 256);
 }
 
-void PhysicsSystem::step(float elapsed_ms)
+void PhysicsSystem::integrate(float elapsed_ms)
 {
-	// Used for oscillation
-	PhysicsSystem::oscillate(elapsed_ms);
-
 	// Move bug based on how much time has passed, this is to (partially) avoid
 	// having entities move at different speed based on the machine.
-	auto& motion_registry = registry.motions;
-	for (uint i = 0; i < motion_registry.size(); i++)
-	{
-		Motion& motion = motion_registry.components[i];
-		Entity entity = motion_registry.entities[i];
-		float step_seconds = elapsed_ms / 1000.f;
-
-		if (motion.interpolate){
-			if (elapsed_ms > motion.remaining_time){
-				motion.position = motion.destination;
-				motion.remaining_time = 0;
+	// Motion is stored as structure of arrays (see MotionFields), so the passes below stream over the few
+	// arrays they need instead of whole Motion structs. Both passes run per range of the arrays on the workers.
+	auto& motions = registry.motions;
+	const float step_seconds = elapsed_ms / 1000.f;
+	const bool* interpolate = motions.interpolate.data();
+	const bool* move_z = motions.move_z.data();
+	vec3* position = motions.position.data();
+	vec3* velocity = motions.velocity.data();
+	const vec3* acceleration = motions.acceleration.data();
+	const vec3* destination = motions.destination.data();
+	float* remaining_time = motions.remaining_time.data();
+
+	motions.parallel_for_ranges([=](size_t begin, size_t end) {
+		// Extrapolation, interpolated motions take a zero step so that the pass doesn't branch
+		for (size_t i = begin; i < end; i++)
+		{
+			const float dt = interpolate[i] ? 0.f : step_seconds;
+			velocity[i] += acceleration[i] * dt;
+			position[i] += velocity[i] * dt;
+		}
+
+		// Interpolation
+		for (size_t i = begin; i < end; i++)
+		{
+			if (!interpolate[i])
+				continue;
+			if (elapsed_ms > remaining_time[i]){
+				position[i] = destination[i];
+				remaining_time[i] = 0;
 			}
 			else{
-				motion.position = motion.position + (motion.destination - motion.position) * (elapsed_ms / motion.remaining_time);
-				if (motion.move_z) {
-					motion.position.z = 2.f*sin((M_PI*motion.remaining_time)/500.f);
+				position[i] = position[i] + (destination[i] - position[i]) * (elapsed_ms / remaining_time[i]);
+				if (move_z[i]) {
+					position[i].z = 2.f*sin((M_PI*remaining_time[i])/500.f);
 				}
-				motion.remaining_time -= elapsed_ms;
+				remaining_time[i] -= elapsed_ms;
 			}
 		}
-		else{
-			motion.velocity = motion.velocity + motion.acceleration * step_seconds;
-			motion.position = motion.position + motion.velocity * step_seconds;
-		}
-		
-	}
+	}, 4096);
+}
 
+void PhysicsSystem::collide_fire()
+{
 	// Check for collisions between only fire and animated tiles right now
-	ComponentContainer<Motion>& motion_container = registry.motions;
+	auto& motion_container = registry.motions;
 	for (uint i = 0; i < registry.fire.components.size(); i++)
 	{
 		Entity entity_i = registry.fire.entities[i];
@@ -92,8 +105,8 @@ void PhysicsSystem::step(float elapsed_ms)
 		if (!fire.active || !fire.inUse){
 			continue;
 		}
-		Object object_i = registry.objects.get(entity_i);
-		Motion motion_i = motion_container.get(entity_i);
+		Object object_i = registry.objects.read(entity_i);
+		Motion motion_i = motion_container.read(entity_i);
 		vec3 position = motion_i.position;
 
 		if (position.z < 0){
@@ -117,7 +130,7 @@ void PhysicsSystem::step(float elapsed_ms)
 			if (collides(trans1 * model1, model2)){
 				// Create a collisions event
 				// Will always be fire first
-				registry.collisions.emplace_with_duplicates(entity_i, entity_j);
+				registry.collision_events.push({ entity_i, entity_j });
 			}
 		}
 
@@ -127,20 +140,24 @@ void PhysicsSystem::step(float elapsed_ms)
 			Tile* tile_j = registry.tiles.components[j];
 			model2 = tile_j->model;
 			if (registry.motions.has(entity_j)){
-				Motion motion_j = registry.motions.get(entity_j);
+				Motion motion_j = registry.motions.read(entity_j);
 				mat4 trans2 = translate(mat4(1.0f), motion_j.position);
 				model2 = trans2 * model2;
 			}
 			if (collides(trans1 * model1, model2)){
-				registry.collisions.emplace_with_duplicates(entity_i, entity_j);
+				registry.collision_events.push({ entity_i, entity_j });
 			}
 		}
 	}
 
+	// you may need the following quantities to compute wall positions
+	(float)window_width_px; (float)window_height_px;
+}
+
+void PhysicsSystem::interpolate_enemies(float elapsed_ms)
+{
 	// compute interpolation for enemy movement
-	for (Entity entity : registry.enemies.entities) {
-		Enemy& enemy = registry.enemies.get(entity);
-		Object& object = registry.objects.get(entity);
+	registry.view<Enemy, Object>().each([&](Entity, Enemy& enemy, Object& object) {
 		if (enemy.moving) { // change to if enemy is moving
 			if (enemy.elapsed + elapsed_ms > 500.f) {
 				elapsed_ms = 500.f - enemy.elapsed;
@@ -157,8 +174,5 @@ void PhysicsSystem::step(float elapsed_ms)
 			model[3].z = enemy.startingPos.z + enemy.translateZ(enemy.elapsed);
 			object.model = model;
 		}
-	}
-
-	// you may need the following quantities to compute wall positions
-	(float)window_width_px; (float)window_height_px;
+	});
 }
\ No newline at end of file
@@ -9,9 +9,12 @@
 class PhysicsSystem
 {
 public:
-	void step(float elapsed_ms);
-
+	// The passes of a physics step, in the order they used to run. They are separate systems for the
+	// SystemScheduler, see main.cpp for the components each of them touches.
 	void oscillate(float elapsed_ms);
+	void integrate(float elapsed_ms);
+	void interpolate_enemies(float elapsed_ms);
+	void collide_fire();
 
 	PhysicsSystem()
 	{
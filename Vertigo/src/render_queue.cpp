@@ -0,0 +1,108 @@
+// internal
+#include "render_queue.hpp"
+
+void RenderQueue::sort()
+{
+	const size_t count = packets.size();
+	if (count < 2)
+		return;
+
+	// Bytes that differ between any two keys, the others need no pass
+	uint64_t differing = 0;
+	for (const Packet& packet : packets)
+		differing |= packet.key ^ packets[0].key;
+
+	scratch.resize(count);
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		if (((differing >> shift) & 0xff) == 0)
+			continue;
+
+		std::array<size_t, 256> offsets = {};
+		for (const Packet& packet : packets)
+			offsets[(packet.key >> shift) & 0xff]++;
+		size_t sum = 0;
+		for (size_t& offset : offsets)
+		{
+			const size_t bucket = offset;
+			offset = sum;
+			sum += bucket;
+		}
+		for (const Packet& packet : packets)
+			scratch[offsets[(packet.key >> shift) & 0xff]++] = packet;
+		packets.swap(scratch);
+	}
+}
+
+void RenderStats::write_json(FILE* out) const
+{
+	fprintf(out, "{\"draw_calls\": %u, \"instances\": %u, \"program_changes\": %u, \"vertex_array_changes\": %u, "
+		"\"texture_changes\": %u, \"redundant_binds\": %u, \"culled\": %u}\n",
+		draw_calls, instances, program_changes, vertex_array_changes, texture_changes, redundant_binds, culled);
+}
+
+void GlStateCache::invalidate()
+{
+	program = ~0u;
+	vertex_array = ~0u;
+	active_unit = ~0u;
+	for (auto& unit : textures)
+		unit.fill(~0u);
+}
+
+void GlStateCache::useProgram(GLuint next)
+{
+	if (next == program)
+	{
+		stats.redundant_binds++;
+		return;
+	}
+	glUseProgram(next);
+	program = next;
+	stats.program_changes++;
+}
+
+void GlStateCache::bindVertexArray(GLuint next)
+{
+	if (next == vertex_array)
+	{
+		stats.redundant_binds++;
+		return;
+	}
+	glBindVertexArray(next);
+	vertex_array = next;
+	stats.vertex_array_changes++;
+}
+
+void GlStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	assert(unit < texture_units && (target == GL_TEXTURE_2D || target == GL_TEXTURE_2D_ARRAY));
+	GLuint& bound = textures[unit][target == GL_TEXTURE_2D ? 0 : 1];
+	if (texture == bound)
+	{
+		stats.redundant_binds++;
+		return;
+	}
+	if (unit != active_unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		active_unit = unit;
+	}
+	glBindTexture(target, texture);
+	bound = texture;
+	stats.texture_changes++;
+}
+
+void GlStateCache::drawElements(GLsizei count)
+{
+	glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, nullptr);
+	stats.draw_calls++;
+	stats.instances++;
+}
+
+void GlStateCache::drawElementsInstanced(GLsizei count, GLsizei instances)
+{
+	glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, nullptr, instances);
+	stats.draw_calls++;
+	stats.instances += instances;
+}
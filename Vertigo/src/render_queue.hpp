@@ -0,0 +1,105 @@
+#pragma once
+
+// stlib
+#include <array>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+
+// Passes of a frame, in drawing order
+enum class RENDER_PASS {
+	WORLD = 0,
+	OBJECTS = WORLD + 1, // translucent, back to front
+	FIRE = OBJECTS + 1,
+	OVERLAY = FIRE + 1
+};
+
+// Sort key of a draw, from the most significant bits: pass (8), program (8), texture (16), geometry (8) and
+// depth (24). Draws that share a program and texture end up next to each other, depth orders them within.
+inline uint64_t render_sort_key(RENDER_PASS pass, unsigned int program, unsigned int texture, unsigned int geometry, unsigned int depth)
+{
+	return ((uint64_t)pass << 56) | ((uint64_t)(program & 0xff) << 48) | ((uint64_t)(texture & 0xffff) << 32) |
+		((uint64_t)(geometry & 0xff) << 24) | (uint64_t)(depth & 0xffffff);
+}
+inline RENDER_PASS render_key_pass(uint64_t key) { return (RENDER_PASS)(key >> 56); }
+inline unsigned int render_key_program(uint64_t key) { return (unsigned int)(key >> 48) & 0xff; }
+
+// The draws of a frame. They are pushed in any order and radix sorted by key before they are submitted.
+class RenderQueue
+{
+public:
+	struct Packet
+	{
+		uint64_t key;
+		unsigned int index; // into entities
+	};
+
+	void clear()
+	{
+		packets.clear();
+		entities.clear();
+	}
+
+	void push(uint64_t key, Entity entity)
+	{
+		packets.push_back({ key, (unsigned int)entities.size() });
+		entities.push_back(entity);
+	}
+
+	// Stable LSD radix sort on the bytes of the key, bytes that are the same for all packets are skipped
+	void sort();
+
+	size_t size() const { return packets.size(); }
+	uint64_t key(size_t i) const { return packets[i].key; }
+	Entity entity(size_t i) const { return entities[packets[i].index]; }
+
+private:
+	std::vector<Packet> packets;
+	std::vector<Packet> scratch;
+	std::vector<Entity> entities;
+};
+
+// Draw calls and state changes of a frame. Redundant binds are the ones the state cache dropped, culled counts
+// the tiles and entities left out because their face of the cube was turned away.
+struct RenderStats
+{
+	unsigned int draw_calls = 0;
+	unsigned int instances = 0;
+	unsigned int program_changes = 0;
+	unsigned int vertex_array_changes = 0;
+	unsigned int texture_changes = 0;
+	unsigned int redundant_binds = 0;
+	unsigned int culled = 0;
+
+	void write_json(FILE* out) const;
+};
+
+// Remembers the bound program, vertex array and textures so that binding them again is free. Everything that
+// binds these during drawing has to go through the cache, invalidate() forgets the state (e.g. at the start of a
+// frame, since code outside of the renderer binds textures as well).
+class GlStateCache
+{
+public:
+	static const int texture_units = 2;
+
+	GlStateCache() { invalidate(); }
+	void invalidate();
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertex_array);
+	// Binds on the given unit, target is GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+	void drawElements(GLsizei count);
+	void drawElementsInstanced(GLsizei count, GLsizei instances);
+
+	RenderStats stats;
+
+private:
+	// ~0u is unknown
+	GLuint program = ~0u;
+	GLuint vertex_array = ~0u;
+	GLuint active_unit = ~0u;
+	std::array<std::array<GLuint, 2>, texture_units> textures; // per unit, 2D and 2D array
+};
@@ -2,128 +2,219 @@
 #include "render_system.hpp"
 #include <SDL.h>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 #include "tiny_ecs_registry.hpp"
 #include "world_system.hpp"
 #include <SDL_opengl.h>
 
-void RenderSystem::setLighting(GLint currProgram)
+// The cube's root transform, once per frame instead of once per draw
+void RenderSystem::updateCubeRotation()
 {
-	// light properties
-	glUniform3fv(glGetUniformLocation(currProgram, "dirLight.position"), 1, (float *)&viewPos);
-	glUniform3f(glGetUniformLocation(currProgram, "dirLight.ambient"), 0.3f, 0.3f, 0.3f);
-	glUniform3f(glGetUniformLocation(currProgram, "dirLight.diffuse"), 0.8f, 0.8f, 0.8f);
-	glUniform3f(glGetUniformLocation(currProgram, "dirLight.specular"), 0.5f, 0.5f, 0.5f);
-
-	// material properties
-	glUniform1i(glGetUniformLocation(currProgram, "material.diffuse"), 0);
-	glUniform3f(glGetUniformLocation(currProgram, "material.specular"), 0.5f, 0.5f, 0.5f);
-	glUniform1f(glGetUniformLocation(currProgram, "material.shininess"), 30.f);
-
-	std::string pointLightStr = "pointLights[0]";
-	for (unsigned int i = 0; i < registry.lightSources.entities.size(); i++) {
-		Entity light = registry.lightSources.entities[i];
-		pointLightStr[12] = '0' + i;
-		if (registry.fire.has(light)) {
-			Motion& motion = registry.motions.get(light);
-			Object& object = registry.objects.get(light);
-			mat4 model = translate(mat4(1.f), motion.position) * object.model * scale(mat4(1.f), motion.scale);
-			glUniform3f(glGetUniformLocation(currProgram, (pointLightStr + ".position").c_str()), model[3].x, model[3].y, model[3].z);
-		} else {
-			Billboard& billboard = registry.billboards.get(light);
-			glUniform3f(glGetUniformLocation(currProgram, (pointLightStr + ".position").c_str()), billboard.model[3].x, billboard.model[3].y, billboard.model[3].z);
-		}
-		glUniform3f(glGetUniformLocation(currProgram, (pointLightStr + ".ambient").c_str()), 0.05f, 0.05f, 0.05f);
-		glUniform3f(glGetUniformLocation(currProgram, (pointLightStr + ".diffuse").c_str()), 0.8f, 0.8f, 0.8f);
-		glUniform3f(glGetUniformLocation(currProgram, (pointLightStr + ".specular").c_str()), 1.0f, 1.0f, 1.0f);
-		glUniform1f(glGetUniformLocation(currProgram, (pointLightStr + ".constant").c_str()), 1.f);
-		glUniform1f(glGetUniformLocation(currProgram, (pointLightStr + ".linear").c_str()), 0.09f);
-		glUniform1f(glGetUniformLocation(currProgram, (pointLightStr + ".quadratic").c_str()), 0.032f);
-	}
+	cube_animation = mat4(1.f);
+	if (registry.cubeRoot.size() != 0)
+		cube_animation = toMat4(registry.cubeRoot.components[0].animation);
+	trackball_rotation = mat4(1.f);
+	if (registry.trackBall.size() != 0)
+		trackball_rotation = toMat4(registry.trackBall.components[0].rotation);
+	cube_rotation = trackball_rotation * cube_animation;
 }
 
-void RenderSystem::drawTexturedMesh(Entity entity, const mat4& projection3D, const mat4& view)
+// Gathers the point lights of this frame and bumps lights_version if any of them moved
+void RenderSystem::updateLights()
 {
-	assert(registry.renderRequests.has(entity));
-	const RenderRequest& render_request = registry.renderRequests.get(entity);
-
-	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
-	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
-	const GLuint program = (GLuint)effects[used_effect_enum];
+	bool changed = false;
+
+	// the fire carries its light around
+	size_t fire_lights = 0;
+	registry.view<LightSource, Fire, Motion, Object>().each([&](Entity, LightSource&, Fire&, MotionRef motion, Object& object) {
+		mat4 model = translate(mat4(1.f), motion.position) * cube_animation * object.model * scale(mat4(1.f), motion.scale);
+		vec3 position = vec3(model[3]);
+		if (fire_lights == fire_light_positions.size())
+		{
+			fire_light_positions.push_back(position);
+			changed = true;
+		}
+		else if (fire_light_positions[fire_lights] != position)
+		{
+			fire_light_positions[fire_lights] = position;
+			changed = true;
+		}
+		fire_lights++;
+	});
+	if (fire_lights != fire_light_positions.size())
+	{
+		fire_light_positions.resize(fire_lights);
+		changed = true;
+	}
 
-	// Setting shaders
-	glUseProgram(program);
-	gl_has_errors();
+	// all other lights are billboards sitting on their columns, they only move with the cube
+	const quat animation = registry.cubeRoot.size() != 0 ? registry.cubeRoot.components[0].animation : quat(1,0,0,0);
+	if (registry.billboards.version() != seen_billboards_version || animation != seen_cube_animation)
+	{
+		billboard_light_positions.clear();
+		registry.view<LightSource, Billboard>().each([&](Entity, LightSource&, Billboard& billboard) {
+			billboard_light_positions.push_back(vec3(cube_animation * billboard.model[3]));
+		});
 
-	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
+		// the tiles have them baked in without the turn in progress, like their own models
+		if (registry.billboards.version() != seen_billboards_version)
+		{
+			static_light_positions.clear();
+			registry.view<LightSource, Billboard>().each([&](Entity, LightSource&, Billboard& billboard) {
+				static_light_positions.push_back(vec3(billboard.model[3]));
+			});
+			registry.tiles.mark_all_dirty();
+		}
+		registry.billboards.clear_dirty();
+		seen_billboards_version = registry.billboards.version();
+		seen_cube_animation = animation;
+		changed = true;
+	}
 
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	gl_has_errors();
+	if (changed)
+		lights_version++;
+}
 
-	glm::mat4 model = glm::mat4(1.f);
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
-	// Input data location as in the vertex buffer
-	if (render_request.used_effect == EFFECT_ASSET_ID::TILE)
-	{
-		GLint in_position_loc = glGetAttribLocation(program, "aPos");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "aTex");
-		GLint in_normal_loc = glGetAttribLocation(program, "aNormal");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
+// The terms of the point lights as the lit programs see them. The bake evaluates the same ones.
+static LightUniforms::PointLight pointLightTerms()
+{
+	LightUniforms::PointLight light = {};
+	light.ambient = vec3(0.05f);
+	light.diffuse = vec3(0.8f);
+	light.specular = vec3(1.0f);
+	light.constant = 1.f;
+	light.linear = 0.09f;
+	light.quadratic = 0.032f;
+	light.range = point_light_range;
+	return light;
+}
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-							  sizeof(LightedVertex), (void *)0);
-		gl_has_errors();
+// Attenuation of a point light over distance, fading out to nothing at its range (as CalcPointLight does)
+static float pointLightAttenuation(const LightUniforms::PointLight& light, float distance)
+{
+	const float fade = clamp(1.f - pow(distance / light.range, 4.f), 0.f, 1.f);
+	return fade * fade / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+}
 
-		glEnableVertexAttribArray(in_texcoord_loc);
+// Fills the Lights block, all lit programs read it from there
+void RenderSystem::uploadLights()
+{
+	uploaded_lights_version = lights_version;
+
+	LightUniforms lights = {};
+	lights.dirLight.position = viewPos;
+	lights.dirLight.ambient = vec3(0.3f);
+	lights.dirLight.diffuse = vec3(0.8f);
+	lights.dirLight.specular = vec3(0.5f);
+
+	// the positions go with the clusters, see updateLightClusters
+	lights.pointLight = pointLightTerms();
+	lights.numDynamicLights = (int)fire_light_positions.size();
+	lights.numLights = (int)(fire_light_positions.size() + billboard_light_positions.size());
+
+	glBindBuffer(GL_UNIFORM_BUFFER, light_uniform_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lights), &lights);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	gl_has_errors();
+}
 
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(LightedVertex),
-			(void *)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
-		gl_has_errors();
+// Bins the point lights into the clusters of the camera and uploads them to the light buffer textures. The
+// fire lights come first, so that the lights of a cluster start with the moving ones.
+void RenderSystem::updateLightClusters(const mat4& view, const mat4& projection, vec2 viewport)
+{
+	light_positions.clear();
+	for (vec3 position : fire_light_positions)
+		light_positions.push_back(vec3(trackball_rotation * vec4(position, 1.f)));
+	for (vec3 position : billboard_light_positions)
+		light_positions.push_back(vec3(trackball_rotation * vec4(position, 1.f)));
+	light_clusters.build(light_positions, point_light_range, view, projection, viewport);
+
+	// RGBA32F as buffer textures have no three component formats before GL 4.0
+	std::vector<vec4> positions(light_positions.size());
+	for (size_t i = 0; i < light_positions.size(); i++)
+		positions[i] = vec4(light_positions[i], 1.f);
+
+	auto upload = [&](GLuint buffer, const void* data, size_t size) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	};
+	upload(light_buffers[0], positions.data(), positions.size() * sizeof(vec4));
+	upload(light_buffers[1], light_clusters.clusters().data(), light_clusters.clusters().size() * sizeof(glm::uvec2));
+	upload(light_buffers[2], light_clusters.indices().data(), light_clusters.indices().size() * sizeof(unsigned int));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	gl_has_errors();
+}
 
-		glEnableVertexAttribArray(in_normal_loc);
-		glVertexAttribPointer(
-			in_normal_loc, 3, GL_FLOAT, GL_FALSE, sizeof(LightedVertex),
-			(void *)(5 * sizeof(float))); // note the stride to skip the preceeding vertex position
-		gl_has_errors();
+// Fills the Frame block with the camera of the following draws, the lights are binned for it
+void RenderSystem::uploadFrameUniforms(const mat4& view, const mat4& projection, vec2 viewport)
+{
+	updateLightClusters(view, projection, viewport);
 
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
+	FrameUniforms frame = {};
+	frame.view = view;
+	frame.proj = projection;
+	frame.viewPos = viewPos;
+	frame.clusterScale = light_clusters.scale();
 
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id =
-			texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_uniform_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	gl_has_errors();
+}
 
-		// use 2d
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+// The ambient and diffuse light of the static lights (LightSource billboards) at the corners of a tile quad with
+// the given model, in the frame of the cube. The specular term depends on the view and is left out. A tile is
+// only lit again when it or the lights changed, see markChangedTiles and updateLights.
+mat4x3 RenderSystem::staticTileLight(const mat4& model) const
+{
+	const LightUniforms::PointLight light = pointLightTerms();
 
-		Tile* boxRotate = registry.tiles.get(entity);
-		if (boxRotate->tileState == TileState::E) {
+	// the vertices of the LIGHTING quad, in order (see initializeGlGeometryBuffers)
+	const vec3 corners[4] = { { -0.5f, -0.5f, 0.f }, { -0.5f, 0.5f, 0.f }, { 0.5f, 0.5f, 0.f }, { 0.5f, -0.5f, 0.f } };
 
-			model = mat4(0);
-		}
-		else
+	const vec3 normal = normalize(transpose(inverse(mat3(model))) * vec3(0.f, 0.f, 1.f));
+	mat4x3 baked = mat4x3(0.f);
+	for (int corner = 0; corner < 4; corner++)
+	{
+		const vec3 position = vec3(model * vec4(corners[corner], 1.f));
+		for (vec3 light_position : static_light_positions)
 		{
-			model = boxRotate->model;
+			const float distance = length(light_position - position);
+			if (distance >= light.range)
+				continue;
+			const float diff = distance > 0.f ? max(dot(normal, (light_position - position) / distance), 0.f) : 0.f;
+			baked[corner] += pointLightAttenuation(light, distance) * (light.ambient + light.diffuse * diff);
 		}
+	}
+	return baked;
+}
+
+// The instance of a tile as the tile program reads it. The trackball rotation is left out, it is the same for
+// all tiles and set as a uniform, so that turning the cube doesn't touch the instances.
+TileInstance RenderSystem::tileInstance(Entity entity) const
+{
+	const Tile* tile = registry.tiles.read(entity);
+
+	TileInstance instance;
+	if (tile->tileState == TileState::E)
+	{
+		instance.model = mat4(0);
+	}
+	else
+	{
 		mat4 trans = mat4(1.f);
 		mat4 sca = mat4(1.f);
-		if (registry.motions.has(entity)){
-			Motion& motion = registry.motions.get(entity);
+		if (registry.motions.has(entity)) {
+			const Motion motion = registry.motions.read(entity);
 			trans = translate(mat4(1.f), motion.position);
 			sca = scale(mat4(1.0f), motion.scale);
 		}
-		if (boxRotate->popup) {
-			switch (boxRotate->direction) {
+		if (tile->popup) {
+			switch (tile->direction) {
 				case FACE_DIRECTION::FRONT:
 					trans = translate(mat4(1.f), vec3(0.f, 0.f, popup_height)) * trans;
 					break;
@@ -144,73 +235,271 @@ void RenderSystem::drawTexturedMesh(Entity entity, const mat4& projection3D, con
 					break;
 			}
 		}
-		model = model * sca;
-		model = trans * model;
-		TrackBallInfo& trackball = registry.trackBall.components[0];
-		mat4 mouseRotation = toMat4(trackball.rotation);
-		model = mouseRotation * model;
+		instance.model = trans * tile->model * sca;
+	}
 
-		// Setting uniform values to the currently bound program
-		setLighting(currProgram);
-		glUniform1i(glGetUniformLocation(currProgram, "numLights"), (int)registry.lightSources.entities.size());
-		glUniform1i(glGetUniformLocation(currProgram, "highlighted"), boxRotate->highlighted);
-		if (boxRotate->color != -1)
-			glUniform3fv(glGetUniformLocation(currProgram, "color"), 1, (float *)&controlTileColors[boxRotate->color]);
-		else
-			glUniform3f(glGetUniformLocation(currProgram, "color"), 0.f, 0.f, 0.f);
-		GLuint viewPos_loc = glGetUniformLocation(currProgram, "viewPos");
-		glUniform3fv(viewPos_loc, 1, (float *)&viewPos);
-		gl_has_errors();
-		
-		if (registry.animated.has(entity)){
-			Animated& animated = registry.animated.get(entity);
-			GLuint animated_loc = glGetUniformLocation(currProgram, "animated");
-			glUniform1i(animated_loc, true);
-			GLuint length_loc = glGetUniformLocation(currProgram, "sheet_length");
-			glUniform1i(length_loc, animated.num_intervals);
-			GLuint index_loc = glGetUniformLocation(currProgram, "index");
-			glUniform1i(index_loc, floor(animated.counter_ms * animated.num_intervals / animated.max_ms));
+	// lit where it is drawn, with its motion and popup
+	instance.light = tile->tileState == TileState::E ? mat4x3(0.f) : staticTileLight(instance.model);
+
+	instance.color = tile->color != -1 ? controlTileColors[tile->color] : vec3(0.f);
+	instance.flags = ivec4(tile->highlighted, 1, 0, texture_layers[(GLuint)registry.renderRequests.read(entity).used_texture].layer);
+	if (registry.animated.has(entity)) {
+		const Animated& animated = registry.animated.read(entity);
+		instance.flags.y = animated.num_intervals;
+		instance.flags.z = (int)floor(animated.counter_ms * animated.num_intervals / animated.max_ms);
+	}
+	return instance;
+}
+
+// Puts the drawn tiles into the slots of the instance buffer, by texture array and then face, and uploads all of
+// their instances. Only needed when tiles come or go or move to another run, see markChangedTiles.
+void RenderSystem::layoutTiles(bool menu_buttons)
+{
+	const unsigned int npos = ContainerInterface::npos;
+	tile_slots.clear();
+	tile_runs.clear();
+	changed_tile_slots.clear();
+	for (unsigned int i = 0; i < registry.renderRequests.size(); i++)
+	{
+		const Entity entity = registry.renderRequests.entities[i];
+		const RenderRequest& request = registry.renderRequests.components[i];
+		if (request.used_effect != EFFECT_ASSET_ID::TILE || registry.menuButtons.has(entity) != menu_buttons)
+			continue;
+		tile_slots.push_back({ entity, texture_layers[(GLuint)request.used_texture].array, false });
+	}
+	auto face_of = [&](const TileSlot& slot) {
+		return menu_buttons ? -1 : registry.tiles.read(slot.entity)->coords.f;
+	};
+	std::stable_sort(tile_slots.begin(), tile_slots.end(), [&](const TileSlot& a, const TileSlot& b) {
+		return a.array != b.array ? a.array < b.array : face_of(a) < face_of(b);
+	});
+
+	tile_slot_of.assign(registry.tiles.size(), npos);
+	for (size_t i = 0; i < tile_slots.size(); i++)
+	{
+		const int face = face_of(tile_slots[i]);
+		if (tile_runs.empty() || tile_runs.back().array != tile_slots[i].array || tile_runs.back().face != face)
+			tile_runs.push_back({ tile_slots[i].array, face, i, i });
+		tile_runs.back().end = i + 1;
+		tile_slot_of[registry.tiles.index_of(tile_slots[i].entity)] = (unsigned int)i;
+	}
+
+	// everything is built from scratch, the changes so far are part of it
+	tile_slots_menu = menu_buttons;
+	seen_tiles_layout = registry.tiles.layout_version();
+	seen_render_requests_layout = registry.renderRequests.layout_version();
+	seen_menu_buttons_version = registry.menuButtons.version();
+	seen_animated_layout = registry.animated.layout_version();
+	registry.tiles.clear_dirty();
+	registry.motions.clear_dirty();
+	registry.renderRequests.clear_dirty();
+	seen_tiles_version = registry.tiles.version();
+	seen_motions_version = registry.motions.version();
+	seen_render_requests_version = registry.renderRequests.version();
+
+	glBindBuffer(GL_ARRAY_BUFFER, tile_instance_buffer);
+	if (tile_slots.size() > tile_instance_capacity)
+	{
+		tile_instance_capacity = std::max(tile_slots.size(), 2 * tile_instance_capacity);
+		glBufferData(GL_ARRAY_BUFFER, tile_instance_capacity * sizeof(TileInstance), nullptr, GL_DYNAMIC_DRAW);
+	}
+	tile_instances.resize(tile_slots.size());
+	for (size_t i = 0; i < tile_slots.size(); i++)
+		tile_instances[i] = tileInstance(tile_slots[i].entity);
+	if (!tile_instances.empty())
+		glBufferSubData(GL_ARRAY_BUFFER, 0, tile_instances.size() * sizeof(TileInstance), tile_instances.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gl_has_errors();
+}
+
+// Collects the slots of the tiles whose instance may have changed since the last frame: the ones whose Tile,
+// Motion or RenderRequest was written (see the change tracking of the containers) and the animated ones. Returns
+// false if the slots have to be laid out again instead, because tiles came or went or changed their texture array.
+bool RenderSystem::markChangedTiles(bool menu_buttons)
+{
+	const unsigned int npos = ContainerInterface::npos;
+	if (menu_buttons != tile_slots_menu
+		|| registry.tiles.layout_version() != seen_tiles_layout
+		|| registry.renderRequests.layout_version() != seen_render_requests_layout
+		|| registry.menuButtons.version() != seen_menu_buttons_version
+		|| registry.animated.layout_version() != seen_animated_layout)
+		return false;
+
+	auto mark_slot = [&](unsigned int slot) {
+		if (slot == npos || tile_slots[slot].changed)
+			return;
+		tile_slots[slot].changed = true;
+		changed_tile_slots.push_back(slot);
+	};
+	auto mark_entity = [&](Entity entity) {
+		const unsigned int tile = registry.tiles.index_of(entity);
+		if (tile != npos)
+			mark_slot(tile_slot_of[tile]);
+	};
+
+	auto& render_requests = registry.renderRequests;
+	if (render_requests.version() != seen_render_requests_version)
+	{
+		for (unsigned int i = 0; i < render_requests.size(); i++)
+		{
+			if (!render_requests.is_dirty_at(i))
+				continue;
+			const Entity entity = render_requests.entities[i];
+			const unsigned int tile = registry.tiles.index_of(entity);
+			if (tile == npos)
+				continue;
+			const RenderRequest& request = render_requests.components[i];
+			const unsigned int slot = tile_slot_of[tile];
+			const bool drawn = request.used_effect == EFFECT_ASSET_ID::TILE && registry.menuButtons.has(entity) == menu_buttons;
+			if (drawn != (slot != npos) || (drawn && tile_slots[slot].array != texture_layers[(GLuint)request.used_texture].array))
+				return false;
+			mark_slot(slot);
 		}
-		else{
-			GLuint animated_loc = glGetUniformLocation(currProgram, "animated");
-			glUniform1i(animated_loc, false);
+		render_requests.clear_dirty();
+		seen_render_requests_version = render_requests.version();
+	}
+
+	if (registry.tiles.version() != seen_tiles_version)
+	{
+		for (unsigned int i = 0; i < registry.tiles.size(); i++)
+			if (registry.tiles.is_dirty_at(i))
+				mark_slot(tile_slot_of[i]);
+		registry.tiles.clear_dirty();
+		seen_tiles_version = registry.tiles.version();
+	}
+
+	if (registry.motions.version() != seen_motions_version)
+	{
+		for (unsigned int i = 0; i < registry.motions.size(); i++)
+			if (registry.motions.is_dirty_at(i))
+				mark_entity(registry.motions.entities[i]);
+		registry.motions.clear_dirty();
+		seen_motions_version = registry.motions.version();
+	}
+
+	// the frames of the sheets go on without anyone writing to the tiles
+	for (Entity entity : registry.animated.entities)
+		mark_entity(entity);
+	return true;
+}
+
+// Rebuilds the instances of the changed slots and uploads the consecutive ones that differ from the buffer together
+void RenderSystem::uploadChangedTiles()
+{
+	std::sort(changed_tile_slots.begin(), changed_tile_slots.end());
+	glBindBuffer(GL_ARRAY_BUFFER, tile_instance_buffer);
+	size_t run_begin = 0;
+	size_t run_end = 0;
+	auto upload = [&]() {
+		if (run_end > run_begin)
+			glBufferSubData(GL_ARRAY_BUFFER, run_begin * sizeof(TileInstance), (run_end - run_begin) * sizeof(TileInstance), &tile_instances[run_begin]);
+	};
+	for (unsigned int slot : changed_tile_slots)
+	{
+		tile_slots[slot].changed = false;
+		const TileInstance instance = tileInstance(tile_slots[slot].entity);
+		if (memcmp(&instance, &tile_instances[slot], sizeof(TileInstance)) == 0)
+			continue;
+		tile_instances[slot] = instance;
+		if (slot != run_end)
+		{
+			upload();
+			run_begin = slot;
 		}
+		run_end = slot + 1;
 	}
-	else if (render_request.used_effect == EFFECT_ASSET_ID::PLAYER)
+	upload();
+	changed_tile_slots.clear();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gl_has_errors();
+}
+
+// Draws the tiles of the level (or the level buttons) with an instanced draw per texture array and run of visible
+// faces, each tile picks its layer.
+void RenderSystem::drawTiles(bool menu_buttons)
+{
+	if (markChangedTiles(menu_buttons))
+		uploadChangedTiles();
+	else
+		layoutTiles(menu_buttons);
+	if (tile_slots.empty())
+		return;
+
+	const ProgramInfo& info = program_infos[(GLuint)EFFECT_ASSET_ID::TILE];
+	gl_state.useProgram(effects[(GLuint)EFFECT_ASSET_ID::TILE]);
+	glUniformMatrix4fv(info.uniform(UNIFORM_ID::CUBE_ROTATION), 1, GL_FALSE, (float*)&cube_rotation);
+	gl_has_errors();
+
+	gl_state.bindVertexArray(tile_vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, tile_instance_buffer);
+	const GLsizei num_indices = index_counts[(GLuint)GEOMETRY_BUFFER_ID::LIGHTING];
+	size_t attributes_first = 0;
+	for (size_t run = 0; run < tile_runs.size();)
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "aPos");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "aTex");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
+		const TileRun& first = tile_runs[run++];
+		if (!faceVisible(first.face))
+		{
+			gl_state.stats.culled += (unsigned int)(first.end - first.begin);
+			continue;
+		}
+		// the following visible faces of the same array go into the same draw
+		size_t end = first.end;
+		for (; run < tile_runs.size() && tile_runs[run].array == first.array && faceVisible(tile_runs[run].face); run++)
+			end = tile_runs[run].end;
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-							  sizeof(TexturedVertex), (void *)0);
-		gl_has_errors();
+		// without base instances (GL 4.2) the attributes are moved to the start of the run
+		if (first.begin != attributes_first)
+		{
+			setTileInstanceAttributes(first.begin);
+			attributes_first = first.begin;
+		}
+		gl_state.bindTexture(0, GL_TEXTURE_2D_ARRAY, first.array);
+		gl_state.drawElementsInstanced(num_indices, (GLsizei)(end - first.begin));
+	}
+	if (attributes_first != 0)
+		setTileInstanceAttributes(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gl_has_errors();
+}
 
-		glEnableVertexAttribArray(in_texcoord_loc);
-		// remember to change this if tex0's type changes vec2/vec3
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void *)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
+// Binds the array of a texture to unit 0 and selects the texture's layer in the program
+void RenderSystem::bindTexture(TEXTURE_ASSET_ID id, const ProgramInfo& info)
+{
+	const TextureLayer& texture = texture_layers[(GLuint)id];
+	gl_state.bindTexture(0, GL_TEXTURE_2D_ARRAY, texture.array);
+	glUniform1i(info.uniform(UNIFORM_ID::LAYER), texture.layer);
+	gl_has_errors();
+}
 
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
+void RenderSystem::drawTexturedMesh(Entity entity, const mat4& view)
+{
+	assert(registry.renderRequests.has(entity));
+	const RenderRequest& render_request = registry.renderRequests.read(entity);
 
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id =
-			texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
+	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
+	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
+	const GLuint program = (GLuint)effects[used_effect_enum];
+	const ProgramInfo& info = program_infos[used_effect_enum];
 
-		// use 2d
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+	// Setting shaders
+	gl_state.useProgram(program);
+	gl_has_errors();
+
+	// The geometry's vertex array has its buffers and attribute layout
+	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
+	const GLuint geometry = (GLuint)render_request.used_geometry;
+	gl_state.bindVertexArray(vertex_arrays[geometry]);
+	gl_has_errors();
+
+	glm::mat4 model = glm::mat4(1.f);
+	if (render_request.used_effect == EFFECT_ASSET_ID::PLAYER)
+	{
+		bindTexture(render_request.used_texture, info);
 
 		Player& player = registry.players.get(entity);
 		model = player.model;
 
-		Motion& motion = registry.motions.get(entity);
+		const Motion motion = registry.motions.read(entity);
 		model = translate(mat4(1.f), motion.position) * model;
 
 		TrackBallInfo& trackball = registry.trackBall.components[0];
@@ -219,61 +508,15 @@ void RenderSystem::drawTexturedMesh(Entity entity, const mat4& projection3D, con
 	}
 	else if (render_request.used_effect == EFFECT_ASSET_ID::TEXT)
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "aPos");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "aTex");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
-
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)0);
-		gl_has_errors();
-
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(in_texcoord_loc, 2, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)sizeof(vec3));
-		gl_has_errors();
-
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id =
-			texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
-
-		// use 2d
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+		bindTexture(render_request.used_texture, info);
 
 		Text& boxRotate = registry.text.get(entity);
-		model = boxRotate.model;
-
-		TrackBallInfo& trackball = registry.trackBall.components[0];
-		mat4 mouseRotation = toMat4(trackball.rotation);
-		model = mouseRotation * model;
+		model = cube_rotation * boxRotate.model;
 	}
 	else if (render_request.used_effect == EFFECT_ASSET_ID::BILLBOARD)
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_color_loc = glGetAttribLocation(program, "in_color");
-		gl_has_errors();
-		assert(in_color_loc >= 0);
-
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(ColoredVertex), (void*)0);
-		gl_has_errors();
-
-		glEnableVertexAttribArray(in_color_loc);
-		// remember to change this if tex0's type changes vec2/vec3
-		glVertexAttribPointer(
-			in_color_loc, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex),
-			(void*)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
-
-		Billboard& obj = registry.billboards.get(entity);
-		model = obj.model;
-
-		TrackBallInfo& trackball = registry.trackBall.components[0];
-		mat4 mouseRotation = toMat4(trackball.rotation);
-		model = mouseRotation * model;
+		const Billboard& obj = registry.billboards.read(entity);
+		model = cube_rotation * obj.model;
 
 		// set the upper 3x3 matrix to identity matrix OR the transpose of the view matrix
 		model[0][0] = view[0][0];
@@ -289,7 +532,7 @@ void RenderSystem::drawTexturedMesh(Entity entity, const mat4& projection3D, con
 		model[2][2] = view[2][2];
 
 		// Setting uniform values to the currently bound program
-		GLuint scale_loc = glGetUniformLocation(currProgram, "scale");
+		GLuint scale_loc = info.uniform(UNIFORM_ID::SCALE);
 		glUniform1f(scale_loc, 0.5f);
 		gl_has_errors();
 	}
@@ -298,76 +541,47 @@ void RenderSystem::drawTexturedMesh(Entity entity, const mat4& projection3D, con
 		assert(false && "Type of render request not supported");
 	}
 
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	gl_has_errors();
-
-	GLsizei num_indices = size / sizeof(uint16_t);
+	// Number of indices of the geometry, counted when it was uploaded
+	const GLsizei num_indices = index_counts[geometry];
 
 	// Setting uniform values to the currently bound program
-	GLuint model_loc = glGetUniformLocation(currProgram, "model");
+	GLuint model_loc = info.uniform(UNIFORM_ID::MODEL);
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, (float*)&model);
-	GLuint view_loc = glGetUniformLocation(currProgram, "view");
-	glUniformMatrix4fv(view_loc, 1, GL_FALSE, (float*)&view);
-	GLuint projection_loc = glGetUniformLocation(currProgram, "proj");
-	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, (float*)&projection3D);
 	gl_has_errors();
 
 	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
+	gl_state.drawElements(num_indices);
 	gl_has_errors();
 }
 
-void RenderSystem::drawFire(Entity entity, const mat4& projection3D, const mat4& view) {
+void RenderSystem::drawFire(Entity entity) {
 
-	const RenderRequest& render_request = registry.renderRequests.get(entity);
+	const RenderRequest& render_request = registry.renderRequests.read(entity);
 
 	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
 	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
 	const GLuint program = (GLuint)effects[used_effect_enum];
+	const ProgramInfo& info = program_infos[used_effect_enum];
 
 	// Setting shaders
-	glUseProgram(program);
+	gl_state.useProgram(program);
 	gl_has_errors();
 
+	// The geometry's vertex array has its buffers and attribute layout
 	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
-
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	const GLuint geometry = (GLuint)render_request.used_geometry;
+	gl_state.bindVertexArray(vertex_arrays[geometry]);
 	gl_has_errors();
 
 	glm::mat4 model = glm::mat4(1.f);
-	GLint in_position_loc = glGetAttribLocation(program, "aPos");
-	GLint in_texcoord_loc = glGetAttribLocation(program, "aTex");
-	gl_has_errors();
-	assert(in_texcoord_loc >= 0);
 
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-		sizeof(TexturedVertex), (void*)0);
-	gl_has_errors();
-
-	glEnableVertexAttribArray(in_texcoord_loc);
-	glVertexAttribPointer(in_texcoord_loc, 2, GL_FLOAT, GL_FALSE,
-		sizeof(TexturedVertex), (void*)sizeof(vec3));
-	gl_has_errors();
-
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	gl_has_errors();
+	// Number of indices of the geometry, counted when it was uploaded
+	const GLsizei num_indices = index_counts[geometry];
 
-	GLsizei num_indices = size / sizeof(uint16_t);
-
-	Motion& motion = registry.motions.get(entity);
+	const Motion motion = registry.motions.read(entity);
 
 	Object& object = registry.objects.get(entity);
-	model = object.model;
+	model = cube_animation * object.model;
 	model = scale(model, motion.scale);
 	model = translate(mat4(1.f), motion.position) * model;
 
@@ -381,102 +595,58 @@ void RenderSystem::drawFire(Entity entity, const mat4& projection3D, const mat4&
 	fire.index += 1;
 	if (fire.index >= fire.maxIndex - 1) { fire.index = 0; }
 
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
 	// Setting uniform values to the currently bound program
-	GLuint index_loc = glGetUniformLocation(currProgram, "index");
+	GLuint index_loc = info.uniform(UNIFORM_ID::INDEX);
 	glUniform1i(index_loc, index);
-	GLuint model_loc = glGetUniformLocation(currProgram, "model");
+	GLuint model_loc = info.uniform(UNIFORM_ID::MODEL);
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, (float*)&model);
-	GLuint view_loc = glGetUniformLocation(currProgram, "view");
-	glUniformMatrix4fv(view_loc, 1, GL_FALSE, (float*)&view);
-	GLuint projection_loc = glGetUniformLocation(currProgram, "proj");
-	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, (float*)&projection3D);
-	GLuint mainTexture = glGetUniformLocation(currProgram, "tex0");
+	GLuint mainTexture = info.uniform(UNIFORM_ID::TEX0);
 	glUniform1i(mainTexture, 0);
 	gl_has_errors();
 
-	GLuint texture_id =
-		texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
-
-	// Bind our texture in Texture Unit 0
-	glActiveTexture(GL_TEXTURE0);
-
-	// use 2d
-	glBindTexture(GL_TEXTURE_2D, texture_id);
-	gl_has_errors();
+	bindTexture(render_request.used_texture, info);
 
 	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
+	gl_state.drawElements(num_indices);
 	gl_has_errors();
 }
 
-void RenderSystem::drawObject(Entity entity, const mat4& projection3D, const mat4& view) 
+void RenderSystem::drawObject(Entity entity)
 {
 	if (registry.fire.has(entity) || registry.lightSources.has(entity)) {
 		return;
 	}
 
 	assert(registry.renderRequests.has(entity));
-	const RenderRequest& render_request = registry.renderRequests.get(entity);
+	const RenderRequest& render_request = registry.renderRequests.read(entity);
 
 	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
 	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
 	const GLuint program = (GLuint)effects[used_effect_enum];
+	const ProgramInfo& info = program_infos[used_effect_enum];
 
 	// Setting shaders
-	glUseProgram(program);
+	gl_state.useProgram(program);
 	gl_has_errors();
 
+	// The geometry's vertex array has its buffers and attribute layout
 	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
-
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	const GLuint geometry = (GLuint)render_request.used_geometry;
+	gl_state.bindVertexArray(vertex_arrays[geometry]);
 	gl_has_errors();
 
 	glm::mat4 model = glm::mat4(1.f);
-	GLint in_position_loc = glGetAttribLocation(program, "in_position");
-	GLint in_color_loc = glGetAttribLocation(program, "in_color");
-	GLint in_normal_loc = glGetAttribLocation(program, "in_normal");
-	gl_has_errors();
-
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-		sizeof(ColoredVertex), (void*)0);
-	gl_has_errors();
-
-	glEnableVertexAttribArray(in_color_loc);
-	glVertexAttribPointer(in_color_loc, 3, GL_FLOAT, GL_FALSE,
-		sizeof(ColoredVertex), (void*)sizeof(vec3));
-	gl_has_errors();
-
-	glEnableVertexAttribArray(in_normal_loc);
-	glVertexAttribPointer(in_normal_loc, 3, GL_FLOAT, GL_FALSE,
-		sizeof(ColoredVertex), (void*)(6*sizeof(float)));
-	gl_has_errors();
-
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	gl_has_errors();
 
-	GLsizei num_indices = size / sizeof(uint16_t);
-	// GLsizei num_triangles = num_indices / 3;
+	// Number of indices of the geometry, counted when it was uploaded
+	const GLsizei num_indices = index_counts[geometry];
 
 	Object& object = registry.objects.get(entity);
-	model = object.model;
-
-	TrackBallInfo& trackball = registry.trackBall.components[0];
-	mat4 mouseRotation = toMat4(trackball.rotation);
-	model = mouseRotation * model;
+	model = cube_rotation * object.model;
 
 	mat4 trans = mat4(1.f);
 	mat4 sca = mat4(1.f);
 	if (registry.motions.has(entity)) {
-		Motion& motion = registry.motions.get(entity);
+		const Motion motion = registry.motions.read(entity);
 		trans = translate(mat4(1.f), motion.position);
 		sca = scale(mat4(1.0f), motion.scale);
 	}
@@ -489,52 +659,30 @@ void RenderSystem::drawObject(Entity entity, const mat4& projection3D, const mat
 		}
 	}
 
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
 	// Setting uniform values to the currently bound program
-
-	setLighting(currProgram);
-	glUniform1i(glGetUniformLocation(currProgram, "numLights"), (int)registry.lightSources.entities.size());
-
-	GLuint alpha_loc = glGetUniformLocation(currProgram, "alpha");
+	GLuint alpha_loc = info.uniform(UNIFORM_ID::ALPHA);
 	glUniform1f(alpha_loc, object.alpha);
-	GLuint model_loc = glGetUniformLocation(currProgram, "model");
+	GLuint model_loc = info.uniform(UNIFORM_ID::MODEL);
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, (float*)&model);
-	GLuint translate_loc = glGetUniformLocation(currProgram, "translate");
+	GLuint translate_loc = info.uniform(UNIFORM_ID::TRANSLATE);
 	glUniformMatrix4fv(translate_loc, 1, GL_FALSE, (float*)&trans);
-	GLuint scale_loc = glGetUniformLocation(currProgram, "scale");
+	GLuint scale_loc = info.uniform(UNIFORM_ID::SCALE);
 	glUniformMatrix4fv(scale_loc, 1, GL_FALSE, (float*)&sca);
-	GLuint view_loc = glGetUniformLocation(currProgram, "view");
-	glUniformMatrix4fv(view_loc, 1, GL_FALSE, (float*)&view);
-	GLuint projection_loc = glGetUniformLocation(currProgram, "proj");
-	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, (float*)&projection3D);
-	GLuint mainTexture = glGetUniformLocation(currProgram, "mainTexture");
+	GLuint mainTexture = info.uniform(UNIFORM_ID::MAIN_TEXTURE);
 	glUniform1i(mainTexture, 0);
-	GLuint objColor = glGetUniformLocation(currProgram, "objColor");
+	GLuint objColor = info.uniform(UNIFORM_ID::OBJ_COLOR);
 	glUniform3fv(objColor, 1, (float*)&object.color);
-	GLuint viewPos_loc = glGetUniformLocation(currProgram, "viewPos");
-	glUniform3fv(viewPos_loc, 1, (float *)&viewPos);
-	gl_has_errors();
-
-	/*GLuint texture_id =
-		texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];*/
-
-	// Bind our texture in Texture Unit 0
-	glActiveTexture(GL_TEXTURE0);
-
-	// use 2d
-	glBindTexture(GL_TEXTURE_2D, (GLuint)TEXTURE_ASSET_ID::WOOD);
 	gl_has_errors();
 
 	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
+	gl_state.drawElements(num_indices);
 	gl_has_errors();
 }
 
-void RenderSystem::drawMenu(Entity entity, const mat3 &projection)
+void RenderSystem::drawMenu(Entity entity)
 {
 	assert(registry.renderRequests.has(entity));
-	const RenderRequest& render_request = registry.renderRequests.get(entity);
+	const RenderRequest& render_request = registry.renderRequests.read(entity);
 
 	assert(registry.menus.has(entity));
 	const Menu& menu = registry.menus.get(entity);
@@ -542,88 +690,61 @@ void RenderSystem::drawMenu(Entity entity, const mat3 &projection)
 	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
 	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
 	const GLuint program = (GLuint)effects[used_effect_enum];
+	const ProgramInfo& info = program_infos[used_effect_enum];
 
 	// Setting shaders
-	glUseProgram(program);
+	gl_state.useProgram(program);
 	gl_has_errors();
 
+	// The geometry's vertex array has its buffers and attribute layout
 	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
-
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	gl_has_errors();
-
-	GLint in_position_loc = glGetAttribLocation(program, "in_position");
-	GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-	gl_has_errors();
-	assert(in_texcoord_loc >= 0);
-
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-		sizeof(TexturedVertex), (void*)0);
-	gl_has_errors();
-
-	glEnableVertexAttribArray(in_texcoord_loc);
-	glVertexAttribPointer(
-		in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-		(void*)sizeof(
-			vec3)); // note the stride to skip the preceeding vertex position
-
-	// Enabling and binding texture to slot 0
-	glActiveTexture(GL_TEXTURE0);
+	const GLuint geometry = (GLuint)render_request.used_geometry;
+	gl_state.bindVertexArray(vertex_arrays[geometry]);
 	gl_has_errors();
 
 	assert(registry.renderRequests.has(entity));
 
-	RenderRequest& r = registry.renderRequests.get(entity);
-	GLuint texture_id;
+	const RenderRequest& r = registry.renderRequests.read(entity);
 
 	if (menu.auto_texture_id){
-		texture_id = (GLuint)r.used_texture;
+		// a frame of the cutscene, the texture id is its GL texture (layer -1 selects it)
+		gl_state.bindTexture(1, GL_TEXTURE_2D, (GLuint)r.used_texture);
+		glUniform1i(info.uniform(UNIFORM_ID::LAYER), -1);
+		gl_has_errors();
 	}
 	else{
-		texture_id = texture_gl_handles[(GLuint)r.used_texture];
+		bindTexture(r.used_texture, info);
 	}
 
-	glBindTexture(GL_TEXTURE_2D, texture_id);
-	gl_has_errors();
-
 	// Getting uniform locations for glUniform* calls
-	GLint color_uloc = glGetUniformLocation(program, "fcolor");
+	GLint color_uloc = info.uniform(UNIFORM_ID::FCOLOR);
 	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
 	glUniform3fv(color_uloc, 1, (float*)&color);
 	gl_has_errors();
 
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	gl_has_errors();
-
-	GLsizei num_indices = size / sizeof(uint16_t);
+	// Number of indices of the geometry, counted when it was uploaded
+	const GLsizei num_indices = index_counts[geometry];
 
 	Transform transform;
 
 	if (registry.motions.has(entity)) {
-		Motion& motion = registry.motions.get(entity);
+		const Motion motion = registry.motions.read(entity);
 		transform.translate(vec2(motion.position.x, motion.position.y));
 		transform.scale(vec2(motion.scale.x, motion.scale.y));
 	}
 
-	GLuint transform_loc = glGetUniformLocation(program, "transform");
+	GLuint transform_loc = info.uniform(UNIFORM_ID::TRANSFORM);
 	glUniformMatrix3fv(transform_loc, 1, GL_FALSE, (float*)&transform.mat);
 	gl_has_errors();
 
 	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
+	gl_state.drawElements(num_indices);
 	gl_has_errors();
 }
 
 void RenderSystem::drawToScreen()
 {
-	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::FADE]);
+	gl_state.useProgram(effects[(GLuint)EFFECT_ASSET_ID::FADE]);
 	gl_has_errors();
 	
 	// Clearing backbuffer
@@ -642,49 +763,220 @@ void RenderSystem::drawToScreen()
 	glDisable(GL_DEPTH_TEST);
 
 	// Draw the screen texture on the quad geometry
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
-	glBindBuffer(
-		GL_ELEMENT_ARRAY_BUFFER,
-		index_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]); // Note, GL_ELEMENT_ARRAY_BUFFER associates
-																	 // indices to the bound GL_ARRAY_BUFFER
+	gl_state.bindVertexArray(vertex_arrays[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
 	gl_has_errors();
 
-	const GLuint fade_program = effects[(GLuint)EFFECT_ASSET_ID::FADE];
+	const ProgramInfo& info = program_infos[(GLuint)EFFECT_ASSET_ID::FADE];
 	// Set clock
-	GLuint time_uloc = glGetUniformLocation(fade_program, "time");
-	GLuint dead_timer_uloc = glGetUniformLocation(fade_program, "darken_screen_factor");
+	GLuint time_uloc = info.uniform(UNIFORM_ID::TIME);
+	GLuint dead_timer_uloc = info.uniform(UNIFORM_ID::DARKEN_SCREEN_FACTOR);
 	glUniform1f(time_uloc, (float)(glfwGetTime() * 10.0f));
 	ScreenState& screen = registry.screenStates.get(screen_state_entity);
 	glUniform1f(dead_timer_uloc, screen.darken_screen_factor);
 	gl_has_errors();
-	// Set the vertex position and vertex texture coordinates (both stored in the
-	// same VBO)
-	GLint in_position_loc = glGetAttribLocation(fade_program, "in_position");
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
-	gl_has_errors();
 
 	// Bind our texture in Texture Unit 0
-	glActiveTexture(GL_TEXTURE0);
-
-	glBindTexture(GL_TEXTURE_2D, off_screen_render_buffer_color);
+	gl_state.bindTexture(0, GL_TEXTURE_2D, off_screen_render_buffer_color);
 	gl_has_errors();
-	// Draw
-	glDrawElements(
-		GL_TRIANGLES, 3, GL_UNSIGNED_SHORT,
-		nullptr); // one triangle = 3 vertices; nullptr indicates that there is
-				  // no offset from the bound index buffer
+	// Draw, one triangle = 3 vertices
+	gl_state.drawElements(index_counts[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
 	gl_has_errors();
 }
 
 // Render our game world
 // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/
+// Draw order of the render requests: grouped by program, then texture, then geometry so consecutive draws share state
+// Sort key bits of a texture: draws of textures in the same array need no bind in between
+unsigned int RenderSystem::textureSortKey(TEXTURE_ASSET_ID id) const
+{
+	return texture_layers[(GLuint)id].array;
+}
+
+// Depth for the sort key, the farthest first
+static unsigned int backToFrontDepth(const mat4& view, vec3 position)
+{
+	const float max_distance = 100.f;
+	const float distance = clamp(-(view * vec4(position, 1.f)).z, 0.f, max_distance);
+	return 0xffffff - (unsigned int)(distance / max_distance * 0xffffff);
+}
+
+// Culling hysteresis: a hidden face is drawn again once its normal is less than face_show_margin from being
+// perpendicular to the view, a drawn one is hidden when it has turned away by more than face_hide_margin. The
+// margins keep faces from flickering while the cube rotates past the edge.
+const float face_show_margin = 0.1f;
+const float face_hide_margin = 0.2f;
+
+// Finds the faces that point towards the camera, after the rotations of the cube and the trackball
+void RenderSystem::updateFaceVisibility(const mat4& view)
+{
+	// A tile of every face gives its normal. The ones found are kept for as long as they exist, the tiles don't
+	// change faces.
+	bool missing = false;
+	for (unsigned int id : face_tiles)
+		missing |= !registry.tiles.has(Entity::from_id(id));
+	if (missing)
+	{
+		face_tiles.fill(0);
+		for (unsigned int i = 0; i < registry.tiles.size(); i++)
+		{
+			const Entity entity = registry.tiles.entities[i];
+			const int face = registry.tiles.components[i]->coords.f;
+			if (face >= 0 && face < 6 && face_tiles[face] == 0 && !registry.menuButtons.has(entity))
+				face_tiles[face] = entity;
+		}
+	}
+	if (std::find(face_tiles.begin(), face_tiles.end(), 0u) != face_tiles.end())
+	{
+		face_visible.fill(true);
+		return;
+	}
+
+	// the projection is orthographic, so the direction to the camera is the same everywhere
+	to_camera = vec3(view[0][2], view[1][2], view[2][2]);
+	const mat3 rotation = mat3(cube_rotation);
+	std::array<vec3, 6> normals;
+	for (int face = 0; face < 6; face++)
+	{
+		// the quad's normal is +z
+		const Tile* tile = registry.tiles.read(Entity::from_id(face_tiles[face]));
+		normals[face] = normalize(rotation * mat3(tile->model) * vec3(0.f, 0.f, 1.f));
+		const float facing = dot(normals[face], to_camera);
+		face_visible[face] = face_visible[face] ? facing > -face_hide_margin : facing > -face_show_margin;
+	}
+	cube_axes = mat3(normals[(int)FACE_DIRECTION::RIGHT], normals[(int)FACE_DIRECTION::TOP], normals[(int)FACE_DIRECTION::FRONT]);
+	cube_half_extent = screen_cube.size / 2.f;
+}
+
+// Whether a sphere is covered by the cube as seen from the camera: the ray from its center towards the camera
+// has to go through the cube shrunk by the radius, then the rays from all of its points go through the cube.
+bool RenderSystem::behindCube(vec3 center, float radius) const
+{
+	const float extent = cube_half_extent - radius;
+	if (extent <= 0.f)
+		return false;
+
+	// slab test in the frame of the cube, where it is the box [-extent, extent]^3
+	const mat3 to_cube = transpose(cube_axes);
+	const vec3 origin = to_cube * center;
+	const vec3 direction = to_cube * to_camera;
+	float t_min = 0.f;
+	float t_max = std::numeric_limits<float>::max();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (abs(direction[axis]) < 1e-6f)
+		{
+			if (abs(origin[axis]) > extent)
+				return false;
+			continue;
+		}
+		const float t0 = (-extent - origin[axis]) / direction[axis];
+		const float t1 = (extent - origin[axis]) / direction[axis];
+		t_min = std::max(t_min, std::min(t0, t1));
+		t_max = std::min(t_max, std::max(t0, t1));
+		if (t_min > t_max)
+			return false;
+	}
+	return true;
+}
+
+// Fills the render queue with the draws of this frame
+void RenderSystem::queueDraws(const mat4& view)
+{
+	render_queue.clear();
+
+	if (registry.menuButtons.entities.size() != 0) {
+		// the tiles of the level buttons are one draw
+		render_queue.push(render_sort_key(RENDER_PASS::WORLD, (unsigned int)EFFECT_ASSET_ID::TILE, 0, 0, 0), registry.menuButtons.entities[0]);
+	}
+	else {
+		bool tiles_queued = false;
+		for (Entity entity : registry.renderRequests.entities)
+		{
+			const RenderRequest& request = registry.renderRequests.read(entity);
+			switch (request.used_effect) {
+			case EFFECT_ASSET_ID::TILE:
+				// all tiles are one draw
+				if (!tiles_queued)
+					render_queue.push(render_sort_key(RENDER_PASS::WORLD, (unsigned int)request.used_effect, 0, 0, 0), entity);
+				tiles_queued = true;
+				break;
+			case EFFECT_ASSET_ID::OBJECT:
+			case EFFECT_ASSET_ID::FIRE:
+			case EFFECT_ASSET_ID::MENU:
+				// queued below
+				break;
+			default:
+				if (registry.text.has(entity) && !faceVisible(registry.text.get(entity).face))
+				{
+					gl_state.stats.culled++;
+					break;
+				}
+				if (registry.billboards.has(entity))
+				{
+					// the sprites are scaled by 0.5 in drawTexturedMesh
+					const Billboard& billboard = registry.billboards.read(entity);
+					const vec3 position = vec3((cube_rotation * billboard.model)[3]);
+					if (!faceVisible(billboard.face) && behindCube(position, 0.5f))
+					{
+						gl_state.stats.culled++;
+						break;
+					}
+				}
+				render_queue.push(render_sort_key(RENDER_PASS::WORLD, (unsigned int)request.used_effect,
+					textureSortKey(request.used_texture), (unsigned int)request.used_geometry, 0), entity);
+			}
+		}
+
+		// the objects are translucent
+		for (Entity entity : registry.objects.entities)
+		{
+			const RenderRequest& request = registry.renderRequests.read(entity);
+			if (request.used_effect != EFFECT_ASSET_ID::OBJECT || registry.fire.has(entity) || registry.lightSources.has(entity))
+				continue;
+			const Object& object = registry.objects.get(entity);
+			const mat4 model = cube_rotation * object.model;
+			vec3 position = vec3(model[3]);
+			vec3 scale = vec3(1.f);
+			if (registry.motions.has(entity)) {
+				const Motion motion = registry.motions.read(entity);
+				position += motion.position;
+				scale = motion.scale;
+			}
+			if (!faceVisible(object.objectPos.f))
+			{
+				const float model_scale = std::max(length(model[0]), std::max(length(model[1]), length(model[2])));
+				const float radius = mesh_radii[(int)request.used_geometry] * model_scale * std::max(abs(scale.x), std::max(abs(scale.y), abs(scale.z)));
+				if (behindCube(position, radius))
+				{
+					gl_state.stats.culled++;
+					continue;
+				}
+			}
+			render_queue.push(render_sort_key(RENDER_PASS::OBJECTS, (unsigned int)request.used_effect, 0,
+				(unsigned int)request.used_geometry, backToFrontDepth(view, position)), entity);
+		}
+
+		if (registry.fire.entities.size() != 0)
+			render_queue.push(render_sort_key(RENDER_PASS::FIRE, (unsigned int)EFFECT_ASSET_ID::FIRE, 0, 0, 0), registry.fire.entities[0]);
+	}
+
+	// the overlays keep their order, they are drawn on top of each other
+	for (unsigned int i = 0; i < registry.menus.entities.size(); i++)
+		render_queue.push(render_sort_key(RENDER_PASS::OVERLAY, (unsigned int)EFFECT_ASSET_ID::MENU, 0, 0, i), registry.menus.entities[i]);
+
+	render_queue.sort();
+}
+
 void RenderSystem::draw()
 {
 	// Getting size of window
 	int w, h;
 	glfwGetFramebufferSize(window, &w, &h); // Note, this will be 2x the resolution given to glfwCreateWindow on retina displays
 
+	// Textures may have been bound outside of the renderer
+	gl_state.invalidate();
+	gl_state.stats = RenderStats();
+
 	// First render to the custom framebuffer
 	glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer); // have to set this variable to 0 instead of frame_buffer in order for it to render
 	gl_has_errors();
@@ -705,62 +997,48 @@ void RenderSystem::draw()
 	
 	mat4 projection_3D = create3DProjectionMatrix(w, h);
 	mat4 view = createViewMatrix();
-	mat3 projection = createProjectionMatrix();
-
-	if (registry.menuButtons.entities.size() == 0){
-		// Draw all textured meshes that have a position and size component
-		for (Entity entity : registry.renderRequests.entities)
-		{
-			RenderRequest& request = registry.renderRequests.get(entity);
 
-			if (request.used_effect == EFFECT_ASSET_ID::OBJECT) {
-				continue;
-			}
+	updateCubeRotation();
+	updateLights();
+	if (uploaded_lights_version != lights_version)
+		uploadLights();
 
-			if (request.used_effect == EFFECT_ASSET_ID::FIRE) {
-				continue;
-			}
-
-			if (request.used_effect == EFFECT_ASSET_ID::MENU) {
-				continue;
-			}
-			// Note, its not very efficient to access elements indirectly via the entity
-			// albeit iterating through all Sprites in sequence. A good point to optimize
-			drawTexturedMesh(entity, projection_3D, view);
-		}
-
-		for (Entity entity : registry.objects.entities) {
-
-			RenderRequest& request = registry.renderRequests.get(entity);
-
-			if (request.used_effect == EFFECT_ASSET_ID::OBJECT) {
-				drawObject(entity, projection_3D, view);
-			}
-		}
-
-		if (registry.fire.entities.size() != 0) {
-			drawFire(registry.fire.entities.at(0), projection_3D, view);
-		}
-		for (Entity entity : registry.menus.entities)
-		{
-			drawMenu(entity, projection);
-		}
+	if (registry.menuButtons.entities.size() == 0){
+		uploadFrameUniforms(view, projection_3D, vec2(w, h));
+		updateFaceVisibility(view);
 	}
 	else{
-		for (Entity entity : registry.menuButtons.entities)
-		{
-			drawTexturedMesh(entity, create3DProjectionMatrixPerspective(w, h), lookAt(vec3(0.0f, 0.0f, 8.0f),
-																				vec3(0.0f, 0.0f, 0.0f),
-																				vec3(0.0f, 1.0f, 0.0f)));
-		}
-		for (Entity entity : registry.menus.entities)
-		{
-			drawMenu(entity, projection);
+		// the level buttons are seen through their own camera
+		projection_3D = create3DProjectionMatrixPerspective(w, h);
+		view = lookAt(vec3(0.0f, 0.0f, 8.0f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+		uploadFrameUniforms(view, projection_3D, vec2(w, h));
+	}
+
+	queueDraws(view);
+	for (size_t i = 0; i < render_queue.size(); i++)
+	{
+		const Entity entity = render_queue.entity(i);
+		switch ((EFFECT_ASSET_ID)render_key_program(render_queue.key(i))) {
+		case EFFECT_ASSET_ID::TILE:
+			drawTiles(registry.menuButtons.has(entity));
+			break;
+		case EFFECT_ASSET_ID::OBJECT:
+			drawObject(entity);
+			break;
+		case EFFECT_ASSET_ID::FIRE:
+			drawFire(entity);
+			break;
+		case EFFECT_ASSET_ID::MENU:
+			drawMenu(entity);
+			break;
+		default:
+			drawTexturedMesh(entity, view);
 		}
 	}
 
 	// Truely render to the screen
 	drawToScreen();
+	last_frame_stats = gl_state.stats;
 
 	// flicker-free display with a double buffer
 	glfwSwapBuffers(window);
@@ -815,4 +1093,5 @@ mat4 RenderSystem::create3DProjectionMatrixPerspective(int width, int height)
 void RenderSystem::setCube(Cube cube) {
 	screen_cube = cube;
 	viewPos = vec3(screen_cube.size + 0.5f);
+	lights_version++; // the directional light sits at viewPos
 }
\ No newline at end of file
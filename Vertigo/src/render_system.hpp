@@ -1,12 +1,142 @@
 #pragma once
 
 #include <array>
+#include <string>
+#include <unordered_map>
 #include <utility>
 
 #include "common.hpp"
 #include "components.hpp"
+#include "light_clusters.hpp"
+#include "render_queue.hpp"
 #include "tiny_ecs.hpp"
 
+// Uniforms the draw paths set, resolved once per program (see ProgramInfo).
+// Make sure these remain in sync with uniform_names in render_system_init.cpp.
+enum class UNIFORM_ID {
+	MODEL = 0,
+	SCALE = MODEL + 1,
+	TRANSLATE = SCALE + 1,
+	TRANSFORM = TRANSLATE + 1,
+	CUBE_ROTATION = TRANSFORM + 1,
+	INDEX = CUBE_ROTATION + 1,
+	FCOLOR = INDEX + 1,
+	OBJ_COLOR = FCOLOR + 1,
+	ALPHA = OBJ_COLOR + 1,
+	MAIN_TEXTURE = ALPHA + 1,
+	TEX0 = MAIN_TEXTURE + 1,
+	LAYER = TEX0 + 1,
+	CUTSCENE_FRAME = LAYER + 1,
+	TIME = CUTSCENE_FRAME + 1,
+	DARKEN_SCREEN_FACTOR = TIME + 1,
+	MATERIAL_DIFFUSE = DARKEN_SCREEN_FACTOR + 1,
+	MATERIAL_SPECULAR = MATERIAL_DIFFUSE + 1,
+	MATERIAL_SHININESS = MATERIAL_SPECULAR + 1,
+	LIGHT_POSITIONS = MATERIAL_SHININESS + 1,
+	LIGHT_CLUSTERS = LIGHT_POSITIONS + 1,
+	LIGHT_INDICES = LIGHT_CLUSTERS + 1,
+	UNIFORM_COUNT = LIGHT_INDICES + 1
+};
+const int uniform_count = (int)UNIFORM_ID::UNIFORM_COUNT;
+
+// Vertex attribute locations, declared with layout(location = ...) by every vertex shader so that the
+// vertex arrays of a geometry work with any program
+const GLuint position_location = 0;
+const GLuint texcoord_location = 1; // or the color of ColoredVertex
+const GLuint color_location = 1;
+const GLuint normal_location = 2;
+
+// Per instance attributes of the tile program, see drawTiles
+const GLuint instance_model_location = 3; // a mat4 takes the four locations 3 to 6
+const GLuint instance_color_location = 7;
+const GLuint instance_flags_location = 8;
+const GLuint instance_light_location = 9; // a mat4x3 takes the four locations 9 to 12
+
+// One tile in the instance buffer. Flags are highlighted, the length of the animation sheet (1 if not
+// animated), the current frame of it and the layer of the tile's texture. Light is the baked light of the static
+// lights at the four corners of the quad (see staticTileLight).
+struct TileInstance
+{
+	mat4 model;
+	vec3 color;
+	ivec4 flags;
+	mat4x3 light;
+};
+
+// Where a texture lives: the textures of the same size share a GL_TEXTURE_2D_ARRAY, one layer each
+struct TextureLayer
+{
+	GLuint array;
+	GLint layer;
+};
+
+// Uniform blocks shared by all programs, uploaded once per frame (or pass) instead of per draw.
+// The structs mirror the std140 layout of the blocks in the shaders: vec3s start on 16 bytes, a following float
+// fills the rest of the slot, structs and array elements are padded to 16 bytes.
+const GLuint frame_uniforms_binding = 0; // the Frame block
+const GLuint light_uniforms_binding = 1; // the Lights block
+
+struct FrameUniforms
+{
+	mat4 view;
+	mat4 proj;
+	vec3 viewPos;
+	float padding;
+	vec4 clusterScale; // see LightClusters::scale
+};
+static_assert(sizeof(FrameUniforms) == 160, "FrameUniforms must match the std140 Frame block");
+
+// The point lights only reach this far, so that a fragment only has to look at the lights of its cluster
+const float point_light_range = 8.f;
+
+// The point lights themselves are in buffer textures, bound to these units for good: the positions (RGBA32F),
+// the offset and count of the lights of every cluster (RG32UI) and the lights of the clusters (R32UI)
+const GLuint light_positions_unit = 2;
+const GLuint light_clusters_unit = 3;
+const GLuint light_indices_unit = 4;
+
+struct LightUniforms
+{
+	struct DirLight
+	{
+		vec3 position; float padding0;
+		vec3 ambient; float padding1;
+		vec3 diffuse; float padding2;
+		vec3 specular; float padding3;
+	} dirLight;
+	// the terms all point lights share
+	struct PointLight
+	{
+		vec3 ambient; float constant;
+		vec3 diffuse; float linear;
+		vec3 specular; float quadratic;
+		float range; float padding[3];
+	} pointLight;
+	int numLights;
+	int numDynamicLights; // the first ones, the lights that move. The tiles have the others baked in.
+	int padding[2];
+};
+static_assert(sizeof(LightUniforms) == 64 + 64 + 16, "LightUniforms must match the std140 Lights block");
+
+// Reflection of a linked program, filled by loadEffectFromFile: the locations of all active uniforms and
+// attributes by name, and the uniforms the draw paths use resolved up front so that drawing does no string work.
+// Anything the program doesn't have (or the compiler optimized away) is -1, which glUniform* ignores.
+struct ProgramInfo
+{
+	std::unordered_map<std::string, GLint> uniforms_by_name;
+	std::unordered_map<std::string, GLint> attributes_by_name;
+	std::array<GLint, uniform_count> uniforms;
+
+	GLint uniform(UNIFORM_ID id) const { return uniforms[(int)id]; }
+
+	// For uniforms without an id, e.g. while debugging a shader
+	GLint uniform(const std::string& name) const
+	{
+		auto it = uniforms_by_name.find(name);
+		return it == uniforms_by_name.end() ? -1 : it->second;
+	}
+};
+
 // System responsible for setting up OpenGL and for rendering all the
 // visual entities in the game
 class RenderSystem {
@@ -17,7 +147,8 @@ class RenderSystem {
 	 * Whenever possible, add to these lists instead of creating dynamic state
 	 * it is easier to debug and faster to execute for the computer.
 	 */
-	std::array<GLuint, texture_count> texture_gl_handles;
+	std::vector<GLuint> texture_arrays;
+	std::array<TextureLayer, texture_count> texture_layers;
 	std::array<ivec2, texture_count> texture_dimensions;
 
 	// Make sure these paths remain in sync with the associated enumerators.
@@ -185,6 +316,7 @@ class RenderSystem {
 	};
 
 	std::array<GLuint, effect_count> effects;
+	std::array<ProgramInfo, effect_count> program_infos;
 	// Make sure these paths remain in sync with the associated enumerators.
 	const std::array<std::string, effect_count> effect_paths = {
 		shader_path("coloured"),
@@ -201,6 +333,9 @@ class RenderSystem {
 
 	std::array<GLuint, geometry_count> vertex_buffers;
 	std::array<GLuint, geometry_count> index_buffers;
+	// A vertex array per geometry with its buffers and attribute layout, so that a draw only binds it
+	std::array<GLuint, geometry_count> vertex_arrays;
+	std::array<GLsizei, geometry_count> index_counts;
 	std::array<Mesh, geometry_count> meshes;
 	// std::array<MeshBox, geometry_count> meshboxs;
 
@@ -213,13 +348,16 @@ public:
 
 	void initializeGlTextures();
 
-	void initializeGlEffects();
+	bool initializeGlEffects();
+
+	void initializeGlUniformBuffers();
 
 	void initializeGlMeshes();
 	Mesh& getMesh(GEOMETRY_BUFFER_ID id) { return meshes[(int)id]; };
 	// MeshBox& getMeshBox(GEOMETRY_BUFFER_ID id) { return meshboxs[(int)id]; };
 
 	void initializeGlGeometryBuffers();
+	void initializeGlTileInstances();
 	// Initialize the screen texture used as intermediate render target
 	// The draw loop first renders to this texture, then it is used for the wind
 	// shader
@@ -230,9 +368,9 @@ public:
 
 	// Draw all entities
 	void draw();
-	void drawFire(Entity entity, const mat4& projection3D, const mat4& view);
-	void drawObject(Entity entity, const mat4& projection3D, const mat4& view);
-	void drawMenu(Entity entity, const mat3& projection);
+	void drawFire(Entity entity);
+	void drawObject(Entity entity);
+	void drawMenu(Entity entity);
 
 	mat4 createViewMatrix();
 	mat3 createProjectionMatrix();
@@ -240,11 +378,111 @@ public:
 	mat4 create3DProjectionMatrixPerspective(int width, int height);
 	void setCube(Cube cube);
 
+	// Draw calls and state changes of the last frame
+	const RenderStats& renderStats() const { return last_frame_stats; }
+
 private:
 	// Internal drawing functions for each entity type
-	void drawTexturedMesh(Entity entity, const mat4& projection3D, const mat4 &view);
+	// view turns the billboards towards the camera, the camera itself is in the Frame block
+	void drawTexturedMesh(Entity entity, const mat4& view);
+	void drawTiles(bool menu_buttons);
+	void layoutTiles(bool menu_buttons);
+	bool markChangedTiles(bool menu_buttons);
+	void uploadChangedTiles();
+	void bindTexture(TEXTURE_ASSET_ID id, const ProgramInfo& info);
+	TileInstance tileInstance(Entity entity) const;
+	mat4x3 staticTileLight(const mat4& model) const;
 	void drawToScreen();
-	void setLighting(GLint currProgram);
+	void queueDraws(const mat4& view);
+	void updateFaceVisibility(const mat4& view);
+	bool faceVisible(int face) const { return face < 0 || face >= 6 || face_visible[face]; }
+	bool behindCube(vec3 center, float radius) const;
+	unsigned int textureSortKey(TEXTURE_ASSET_ID id) const;
+	void updateLights();
+	void uploadLights();
+	void uploadFrameUniforms(const mat4& view, const mat4& projection, vec2 viewport);
+	void updateLightClusters(const mat4& view, const mat4& projection, vec2 viewport);
+
+	// Point light positions of the current frame, in the frame of the cube. The Lights block is only uploaded
+	// again if they changed.
+	std::vector<vec3> fire_light_positions;
+	std::vector<vec3> billboard_light_positions;
+	unsigned int lights_version = 0;
+	unsigned int seen_billboards_version = ~0u;
+	unsigned int uploaded_lights_version = ~0u;
+
+	// The static lights as the tiles have them baked in, see staticTileLight
+	std::vector<vec3> static_light_positions;
+
+	// The point lights of the pass with the trackball applied, the fire lights first, and their clusters
+	std::vector<vec3> light_positions;
+	LightClusters light_clusters;
+
+	// Instanced tiles: the LIGHTING geometry with a buffer of TileInstance. Every drawn tile keeps its slot in the
+	// buffer from frame to frame, ordered by texture array and then face so that the visible tiles of an array are
+	// a few instanced draws. Only the slots of the tiles that changed are rebuilt (see markChangedTiles), and of
+	// those only the instances that differ from what the buffer holds (tile_instances) are uploaded again.
+	struct TileSlot
+	{
+		Entity entity;
+		GLuint array;
+		bool changed;
+	};
+	struct TileRun
+	{
+		GLuint array;
+		int face; // -1 for the level buttons, which are never culled
+		size_t begin;
+		size_t end;
+	};
+	GLuint tile_vertex_array;
+	GLuint tile_instance_buffer;
+	size_t tile_instance_capacity = 0;
+	std::vector<TileInstance> tile_instances;
+	std::vector<TileSlot> tile_slots;
+	std::vector<TileRun> tile_runs;
+	std::vector<unsigned int> tile_slot_of; // slot of every position in registry.tiles, npos if it isn't drawn
+	std::vector<unsigned int> changed_tile_slots;
+	bool tile_slots_menu = false; // whether the slots hold the level buttons
+	// what the slots were built from
+	unsigned int seen_tiles_layout = ~0u;
+	unsigned int seen_render_requests_layout = ~0u;
+	unsigned int seen_menu_buttons_version = ~0u;
+	unsigned int seen_animated_layout = ~0u;
+	// the changes the slots are up to date with
+	unsigned int seen_tiles_version = ~0u;
+	unsigned int seen_motions_version = ~0u;
+	unsigned int seen_render_requests_version = ~0u;
+
+	// Faces of the cube that can be seen. Tiles and text on the others are skipped, objects and billboards stick
+	// out of their face and are only skipped if the cube covers them as well.
+	std::array<bool, 6> face_visible = { { true, true, true, true, true, true } };
+	std::array<unsigned int, 6> face_tiles = { { 0, 0, 0, 0, 0, 0 } }; // a tile of every face (raw ids, 0 for none)
+	mat3 cube_axes = mat3(1.f); // the normals of the right, top and front faces
+	float cube_half_extent = 0.f;
+
+	// Transform of the cube's root for the frame: the turn in progress (CubeRoot) and the trackball on top of it.
+	// Everything on the cube is drawn with cube_rotation in front of its model.
+	void updateCubeRotation();
+	mat4 cube_animation = mat4(1.f);
+	mat4 trackball_rotation = mat4(1.f);
+	mat4 cube_rotation = mat4(1.f);
+	quat seen_cube_animation = quat(1,0,0,0); // the billboard lights were placed with
+	vec3 to_camera = vec3(0.f, 0.f, 1.f);
+	std::array<float, geometry_count> mesh_radii; // of the vertices around the origin, for culling
+
+	// The draws of the frame and the GL state they are submitted through
+	RenderQueue render_queue;
+	GlStateCache gl_state;
+	RenderStats last_frame_stats;
+
+	// Buffers behind the shared uniform blocks
+	GLuint frame_uniform_buffer;
+	GLuint light_uniform_buffer;
+
+	// Buffers behind the light buffer textures, in the order of the units
+	std::array<GLuint, 3> light_buffers;
+	std::array<GLuint, 3> light_textures;
 
 	// Window handle
 	GLFWwindow* window;
@@ -260,4 +498,7 @@ private:
 };
 
 bool loadEffectFromFile(
-	const std::string& vs_path, const std::string& fs_path, GLuint& out_program);
\ No newline at end of file
+	const std::string& vs_path, const std::string& fs_path, GLuint& out_program, ProgramInfo& out_info);
+
+// Points the per instance attributes of the bound vertex array at the tile instance buffer, from instance first on
+void setTileInstanceAttributes(size_t first);
@@ -1,6 +1,7 @@
 // internal
 #include "render_system.hpp"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 
@@ -48,30 +49,66 @@ bool RenderSystem::init(GLFWwindow* window_arg)
 	// code to use OpenGL 4.3 (not suported on mac) and add additional .h and .cpp
 	// glDebugMessageCallback((GLDEBUGPROC)errorCallback, nullptr);
 
-	// We are not really using VAO's but without at least one bound we will crash in
-	// some systems.
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-	gl_has_errors();
-
 	initScreenTexture();
 	initializeGlTextures();
-	initializeGlEffects();
+	if (!initializeGlEffects())
+		return false;
+	initializeGlUniformBuffers();
 	initializeGlGeometryBuffers();
+	initializeGlTileInstances();
 
 	return true;
 }
 
+// Packs the textures into arrays by size, so that draws of different textures of a size can be batched
 void RenderSystem::initializeGlTextures()
 {
-	glGenTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
-
+	// Sizes first, each new size gets an array
+	std::vector<ivec2> array_dimensions;
+	std::vector<GLint> array_layers;
 	for (uint i = 0; i < texture_paths.size(); i++)
 	{
 		const std::string& path = texture_paths[i];
 		ivec2& dimensions = texture_dimensions[i];
 
+		if (!stbi_info(path.c_str(), &dimensions.x, &dimensions.y, NULL))
+		{
+			const std::string message = "Could not load the file " + path + ".";
+			fprintf(stderr, "%s", message.c_str());
+			assert(false);
+		}
+		auto it = std::find(array_dimensions.begin(), array_dimensions.end(), dimensions);
+		const uint array = (uint)(it - array_dimensions.begin());
+		if (it == array_dimensions.end())
+		{
+			array_dimensions.push_back(dimensions);
+			array_layers.push_back(0);
+		}
+		// the array is an index into texture_arrays until they are created below
+		texture_layers[i] = { array, array_layers[array]++ };
+	}
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	texture_arrays.resize(array_dimensions.size());
+	glGenTextures((GLsizei)texture_arrays.size(), texture_arrays.data());
+	for (uint i = 0; i < texture_arrays.size(); i++)
+	{
+		assert(array_layers[i] <= max_layers);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture_arrays[i]);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, array_dimensions[i].x, array_dimensions[i].y, array_layers[i], 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		gl_has_errors();
+	}
+
+	for (uint i = 0; i < texture_paths.size(); i++)
+	{
+		const std::string& path = texture_paths[i];
+		TextureLayer& texture = texture_layers[i];
+		texture.array = texture_arrays[texture.array];
+
+		ivec2 dimensions;
 		stbi_uc* data;
 		data = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, NULL, 4);
 
@@ -81,40 +118,163 @@ void RenderSystem::initializeGlTextures()
 			fprintf(stderr, "%s", message.c_str());
 			assert(false);
 		}
-		glBindTexture(GL_TEXTURE_2D, texture_gl_handles[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dimensions.x, dimensions.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture.array);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, texture.layer, dimensions.x, dimensions.y, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
 		gl_has_errors();
 		stbi_image_free(data);
 	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 	gl_has_errors();
 }
 
-void RenderSystem::initializeGlEffects()
+// Fails if a program doesn't build, e.g. because its stages declare a shared block differently
+bool RenderSystem::initializeGlEffects()
 {
 	for (uint i = 0; i < effect_paths.size(); i++)
 	{
 		const std::string vertex_shader_name = effect_paths[i] + ".vs.glsl";
 		const std::string fragment_shader_name = effect_paths[i] + ".fs.glsl";
 
-		bool is_valid = loadEffectFromFile(vertex_shader_name, fragment_shader_name, effects[i]);
-		assert(is_valid && (GLuint)effects[i] != 0);
+		bool is_valid = loadEffectFromFile(vertex_shader_name, fragment_shader_name, effects[i], program_infos[i]);
+		if (!is_valid || (GLuint)effects[i] == 0)
+		{
+			fprintf(stderr, "Failed to build the program of %s\n", effect_paths[i].c_str());
+			return false;
+		}
+
+		// The material is the same for everything that is lit, it stays with the program
+		const ProgramInfo& info = program_infos[i];
+		if (info.uniform(UNIFORM_ID::MATERIAL_SHININESS) >= 0)
+		{
+			glUseProgram(effects[i]);
+			glUniform1i(info.uniform(UNIFORM_ID::MATERIAL_DIFFUSE), 0);
+			glUniform3f(info.uniform(UNIFORM_ID::MATERIAL_SPECULAR), 0.5f, 0.5f, 0.5f);
+			glUniform1f(info.uniform(UNIFORM_ID::MATERIAL_SHININESS), 30.f);
+			gl_has_errors();
+		}
+		// The light buffer textures stay on their units
+		if (info.uniform(UNIFORM_ID::LIGHT_CLUSTERS) >= 0)
+		{
+			glUseProgram(effects[i]);
+			glUniform1i(info.uniform(UNIFORM_ID::LIGHT_POSITIONS), light_positions_unit);
+			glUniform1i(info.uniform(UNIFORM_ID::LIGHT_CLUSTERS), light_clusters_unit);
+			glUniform1i(info.uniform(UNIFORM_ID::LIGHT_INDICES), light_indices_unit);
+			gl_has_errors();
+		}
+		// The cutscene frames are plain 2D textures, they can't share unit 0 with the texture arrays
+		if (info.uniform(UNIFORM_ID::CUTSCENE_FRAME) >= 0)
+		{
+			glUseProgram(effects[i]);
+			glUniform1i(info.uniform(UNIFORM_ID::CUTSCENE_FRAME), 1);
+			gl_has_errors();
+		}
+	}
+	glUseProgram(0);
+	return true;
+}
+
+void RenderSystem::initializeGlUniformBuffers()
+{
+	glGenBuffers(1, &frame_uniform_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_uniform_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frame_uniforms_binding, frame_uniform_buffer);
+
+	glGenBuffers(1, &light_uniform_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, light_uniform_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightUniforms), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, light_uniforms_binding, light_uniform_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	gl_has_errors();
+
+	// The buffer textures of the point lights, updateLightClusters fills their buffers for every pass. Nothing
+	// else binds textures to their units, so they are bound once here.
+	const std::array<GLenum, 3> light_formats = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	const std::array<GLuint, 3> light_units = { light_positions_unit, light_clusters_unit, light_indices_unit };
+	glGenBuffers((GLsizei)light_buffers.size(), light_buffers.data());
+	glGenTextures((GLsizei)light_textures.size(), light_textures.data());
+	for (size_t i = 0; i < light_buffers.size(); i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, light_buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+		glActiveTexture(GL_TEXTURE0 + light_units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, light_textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, light_formats[i], light_buffers[i]);
 	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	gl_has_errors();
 }
 
-// One could merge the following two functions as a template function...
+// Attribute layout of each vertex type in the currently bound vertex array, see position_location etc.
+template <class T>
+static void setVertexAttributes();
+
+static void setVertexAttribute(GLuint location, GLint components, GLsizei stride, size_t offset)
+{
+	glEnableVertexAttribArray(location);
+	glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+}
+template <>
+void setVertexAttributes<vec3>()
+{
+	setVertexAttribute(position_location, 3, sizeof(vec3), 0);
+}
+template <>
+void setVertexAttributes<TexturedVertex>()
+{
+	setVertexAttribute(position_location, 3, sizeof(TexturedVertex), offsetof(TexturedVertex, position));
+	setVertexAttribute(texcoord_location, 2, sizeof(TexturedVertex), offsetof(TexturedVertex, texcoord));
+}
+template <>
+void setVertexAttributes<LightedVertex>()
+{
+	setVertexAttribute(position_location, 3, sizeof(LightedVertex), offsetof(LightedVertex, position));
+	setVertexAttribute(texcoord_location, 2, sizeof(LightedVertex), offsetof(LightedVertex, texcoord));
+	setVertexAttribute(normal_location, 3, sizeof(LightedVertex), offsetof(LightedVertex, normal));
+}
+template <>
+void setVertexAttributes<ColoredVertex>()
+{
+	setVertexAttribute(position_location, 3, sizeof(ColoredVertex), offsetof(ColoredVertex, position));
+	setVertexAttribute(color_location, 3, sizeof(ColoredVertex), offsetof(ColoredVertex, color));
+	setVertexAttribute(normal_location, 3, sizeof(ColoredVertex), offsetof(ColoredVertex, normal));
+}
+
+// The instance buffer has to be bound to GL_ARRAY_BUFFER
+void setTileInstanceAttributes(size_t first)
+{
+	const GLsizei stride = sizeof(TileInstance);
+	const size_t base = first * sizeof(TileInstance);
+	for (GLuint column = 0; column < 4; column++)
+		setVertexAttribute(instance_model_location + column, 4, stride, base + offsetof(TileInstance, model) + column * sizeof(vec4));
+	setVertexAttribute(instance_color_location, 3, stride, base + offsetof(TileInstance, color));
+	glEnableVertexAttribArray(instance_flags_location);
+	glVertexAttribIPointer(instance_flags_location, 4, GL_INT, stride, (void*)(base + offsetof(TileInstance, flags)));
+	for (GLuint column = 0; column < 4; column++)
+		setVertexAttribute(instance_light_location + column, 3, stride, base + offsetof(TileInstance, light) + column * sizeof(vec3));
+}
+
+// Uploads a geometry and records its buffers and vertex layout in the geometry's vertex array
 template <class T>
 void RenderSystem::bindVBOandIBO(GEOMETRY_BUFFER_ID gid, std::vector<T> vertices, std::vector<uint16_t> indices)
 {
+	glBindVertexArray(vertex_arrays[(uint)gid]);
+
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(uint)gid]);
 	glBufferData(GL_ARRAY_BUFFER,
 		sizeof(vertices[0]) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
 	gl_has_errors();
 
+	// the element buffer binding is part of the vertex array
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[(uint)gid]);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 		sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	index_counts[(uint)gid] = (GLsizei)indices.size();
+	gl_has_errors();
+
+	setVertexAttributes<T>();
+	glBindVertexArray(0);
 	gl_has_errors();
 }
 
@@ -133,6 +293,11 @@ void RenderSystem::initializeGlMeshes()
 		bindVBOandIBO(geom_index,
 			meshes[(int)geom_index].vertices,
 			meshes[(int)geom_index].vertex_indices);
+
+		float& radius = mesh_radii[(int)geom_index];
+		radius = 0.f;
+		for (const ColoredVertex& vertex : meshes[(int)geom_index].vertices)
+			radius = std::max(radius, length(vertex.position));
 	}
 }
 
@@ -142,6 +307,10 @@ void RenderSystem::initializeGlGeometryBuffers()
 	glGenBuffers((GLsizei)vertex_buffers.size(), vertex_buffers.data());
 	// Index Buffer creation.
 	glGenBuffers((GLsizei)index_buffers.size(), index_buffers.data());
+	// Vertex array creation, the ones of geometries without data stay empty.
+	glGenVertexArrays((GLsizei)vertex_arrays.size(), vertex_arrays.data());
+	index_counts.fill(0);
+	mesh_radii.fill(0.f);
 
 	// Index and Vertex buffer data initialization.
 	initializeGlMeshes();
@@ -222,13 +391,45 @@ void RenderSystem::initializeGlGeometryBuffers()
 	bindVBOandIBO(GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE, screen_vertices, screen_indices);
 }
 
+// The tile quad with the per instance attributes. The instance buffer starts out empty, drawTiles grows it.
+void RenderSystem::initializeGlTileInstances()
+{
+	glGenVertexArrays(1, &tile_vertex_array);
+	glGenBuffers(1, &tile_instance_buffer);
+
+	glBindVertexArray(tile_vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(uint)GEOMETRY_BUFFER_ID::LIGHTING]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[(uint)GEOMETRY_BUFFER_ID::LIGHTING]);
+	setVertexAttributes<LightedVertex>();
+
+	glBindBuffer(GL_ARRAY_BUFFER, tile_instance_buffer);
+	for (GLuint column = 0; column < 4; column++)
+		glVertexAttribDivisor(instance_model_location + column, 1);
+	glVertexAttribDivisor(instance_color_location, 1);
+	glVertexAttribDivisor(instance_flags_location, 1);
+	for (GLuint column = 0; column < 4; column++)
+		glVertexAttribDivisor(instance_light_location + column, 1);
+	setTileInstanceAttributes(0);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gl_has_errors();
+}
+
 RenderSystem::~RenderSystem()
 {
 	// Don't need to free gl resources since they last for as long as the program,
 	// but it's polite to clean after yourself.
 	glDeleteBuffers((GLsizei)vertex_buffers.size(), vertex_buffers.data());
 	glDeleteBuffers((GLsizei)index_buffers.size(), index_buffers.data());
-	glDeleteTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
+	glDeleteVertexArrays((GLsizei)vertex_arrays.size(), vertex_arrays.data());
+	glDeleteVertexArrays(1, &tile_vertex_array);
+	glDeleteBuffers(1, &tile_instance_buffer);
+	glDeleteBuffers(1, &frame_uniform_buffer);
+	glDeleteBuffers(1, &light_uniform_buffer);
+	glDeleteBuffers((GLsizei)light_buffers.size(), light_buffers.data());
+	glDeleteTextures((GLsizei)light_textures.size(), light_textures.data());
+	glDeleteTextures((GLsizei)texture_arrays.size(), texture_arrays.data());
 	glDeleteTextures(1, &off_screen_render_buffer_color);
 	glDeleteRenderbuffers(1, &off_screen_render_buffer_depth);
 	gl_has_errors();
@@ -295,8 +496,98 @@ bool gl_compile_shader(GLuint shader)
 	return true;
 }
 
+// Make sure these remain in sync with the associated enumerators.
+static const std::array<const char*, uniform_count> uniform_names = {
+	"model",
+	"scale",
+	"translate",
+	"transform",
+	"cube_rotation",
+	"index",
+	"fcolor",
+	"objColor",
+	"alpha",
+	"mainTexture",
+	"tex0",
+	"layer",
+	"cutscene_frame",
+	"time",
+	"darken_screen_factor",
+	"material.diffuse",
+	"material.specular",
+	"material.shininess",
+	"lightPositions",
+	"lightClusters",
+	"lightIndices"
+};
+// Collects the active uniforms and attributes of a linked program, resolves the ones with an id and
+// connects the shared uniform blocks to their buffers. Fails if a block doesn't have the size of its struct.
+static bool reflectProgram(GLuint program, ProgramInfo& info)
+{
+	GLint count = 0, max_length = 0;
+	GLint size;
+	GLenum type;
+	GLsizei length;
+
+	// Arrays of plain types are reported once as "name[0]", their elements have consecutive locations.
+	// Arrays of structs are reported per member of every element, e.g. "pointLights[1].position".
+	info.uniforms_by_name.clear();
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::vector<char> name(std::max(max_length, 1));
+	for (GLint i = 0; i < count; i++)
+	{
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+		std::string uniform(name.data(), length);
+		const GLint location = glGetUniformLocation(program, uniform.c_str());
+		info.uniforms_by_name[uniform] = location;
+		const size_t bracket = uniform.size() > 3 ? uniform.size() - 3 : std::string::npos;
+		if (bracket != std::string::npos && uniform.compare(bracket, 3, "[0]") == 0)
+		{
+			const std::string base = uniform.substr(0, bracket);
+			info.uniforms_by_name[base] = location;
+			for (GLint element = 1; element < size; element++)
+				info.uniforms_by_name[base + "[" + std::to_string(element) + "]"] = location + element;
+		}
+	}
+
+	info.attributes_by_name.clear();
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+	name.resize(std::max(max_length, 1));
+	for (GLint i = 0; i < count; i++)
+	{
+		glGetActiveAttrib(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+		std::string attribute(name.data(), length);
+		info.attributes_by_name[attribute] = glGetAttribLocation(program, attribute.c_str());
+	}
+	gl_has_errors();
+
+	for (int i = 0; i < uniform_count; i++)
+		info.uniforms[i] = info.uniform(uniform_names[i]);
+
+	auto bindBlock = [&](const char* block_name, GLuint binding, GLint expected_size) {
+		const GLuint block = glGetUniformBlockIndex(program, block_name);
+		if (block == GL_INVALID_INDEX)
+			return true;
+		GLint block_size = 0;
+		glGetActiveUniformBlockiv(program, block, GL_UNIFORM_BLOCK_DATA_SIZE, &block_size);
+		if (block_size != expected_size)
+		{
+			fprintf(stderr, "Uniform block %s is %d bytes, its struct %d\n", block_name, block_size, expected_size);
+			return false;
+		}
+		glUniformBlockBinding(program, block, binding);
+		return true;
+	};
+	const bool blocks_match = bindBlock("Frame", frame_uniforms_binding, (GLint)sizeof(FrameUniforms)) &&
+		bindBlock("Lights", light_uniforms_binding, (GLint)sizeof(LightUniforms));
+	gl_has_errors();
+	return blocks_match;
+}
+
 bool loadEffectFromFile(
-	const std::string& vs_path, const std::string& fs_path, GLuint& out_program)
+	const std::string& vs_path, const std::string& fs_path, GLuint& out_program, ProgramInfo& out_info)
 {
 	// Opening files
 	std::ifstream vs_is(vs_path);
@@ -357,7 +648,7 @@ bool loadEffectFromFile(
 			glGetProgramInfoLog(out_program, log_len, &log_len, log.data());
 			gl_has_errors();
 
-			fprintf(stderr, "Link error: %s", log.data());
+			fprintf(stderr, "Link error (%s, %s): %s", vs_path.c_str(), fs_path.c_str(), log.data());
 			assert(false);
 			return false;
 		}
@@ -371,5 +662,5 @@ bool loadEffectFromFile(
 	glDeleteShader(fragment);
 	gl_has_errors();
 
-	return true;
+	return reflectProgram(out_program, out_info);
 }
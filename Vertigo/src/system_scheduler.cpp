@@ -0,0 +1,138 @@
+// internal
+#include "system_scheduler.hpp"
+
+// stlib
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+using Clock = std::chrono::high_resolution_clock;
+
+void SystemScheduler::add(const std::string& name, SystemAccess access, std::function<void(float)> run)
+{
+	System system;
+	system.name = name;
+	system.access = access;
+	system.run = std::move(run);
+	systems.push_back(std::move(system));
+	pending.reset(new std::atomic<unsigned int>[systems.size()]);
+}
+
+void SystemScheduler::build_graph()
+{
+	for (System& system : systems)
+	{
+		system.successors.clear();
+		system.dependencies = 0;
+	}
+	for (unsigned int i = 0; i < systems.size(); i++)
+	{
+		for (unsigned int j = i + 1; j < systems.size(); j++)
+		{
+			if (systems[i].access.conflicts(systems[j].access))
+			{
+				systems[i].successors.push_back(j);
+				systems[j].dependencies++;
+			}
+		}
+	}
+}
+
+void SystemScheduler::run_system(unsigned int i, float elapsed_ms)
+{
+	System& system = systems[i];
+	auto start = Clock::now();
+	system.run(elapsed_ms);
+	double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	// only this task writes the statistics of the system this frame
+	system.total_ms += ms;
+	system.max_ms = std::max(system.max_ms, ms);
+
+	for (unsigned int next : system.successors)
+	{
+		if (pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			schedule(next, elapsed_ms);
+	}
+	systems_left.fetch_sub(1, std::memory_order_release);
+}
+
+// Hands a system whose dependencies are done to the pool, or to the main thread if it has to run there
+void SystemScheduler::schedule(unsigned int i, float elapsed_ms)
+{
+	if (systems[i].access.main_thread)
+	{
+		std::lock_guard<std::mutex> lock(main_thread_mutex);
+		main_thread_systems.push_back(i);
+	}
+	else
+	{
+		pool.submit([this, i, elapsed_ms] { run_system(i, elapsed_ms); });
+	}
+}
+
+void SystemScheduler::run(float elapsed_ms)
+{
+	auto start = Clock::now();
+
+	// Rebuilt every frame, which keeps it correct if a system's access is changed between frames
+	build_graph();
+	for (unsigned int i = 0; i < systems.size(); i++)
+		pending[i].store(systems[i].dependencies, std::memory_order_relaxed);
+	systems_left.store((unsigned int)systems.size(), std::memory_order_relaxed);
+	for (unsigned int i = 0; i < systems.size(); i++)
+	{
+		if (systems[i].dependencies == 0)
+			schedule(i, elapsed_ms);
+	}
+
+	// This thread runs the systems that need the main thread and otherwise helps with the pool's tasks
+	while (systems_left.load(std::memory_order_acquire) > 0)
+	{
+		unsigned int main_thread_system = ~0u;
+		{
+			std::lock_guard<std::mutex> lock(main_thread_mutex);
+			if (!main_thread_systems.empty())
+			{
+				main_thread_system = main_thread_systems.back();
+				main_thread_systems.pop_back();
+			}
+		}
+		if (main_thread_system != ~0u)
+			run_system(main_thread_system, elapsed_ms);
+		else if (!pool.run_one())
+			std::this_thread::yield();
+	}
+	pool.wait();
+
+	frame_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	frames++;
+	since_report_ms += elapsed_ms;
+	if (since_report_ms >= report_interval_ms)
+		report();
+}
+
+void SystemScheduler::report()
+{
+	if (reporting)
+	{
+		printf("System timings over %u frames on %u threads (average / max ms):\n", frames, pool.worker_count() + 1);
+		double sum_ms = 0;
+		for (const System& system : systems)
+		{
+			printf("  %-24s %8.3f %8.3f\n", system.name.c_str(), system.total_ms / frames, system.max_ms);
+			sum_ms += system.total_ms;
+		}
+		// A frame shorter than the sum of its systems is the gain from running them concurrently
+		printf("  %-24s %8.3f (sum of systems %.3f)\n", "frame", frame_ms / frames, sum_ms / frames);
+	}
+
+	// also while not reporting, so that turning it on doesn't show stale numbers
+	for (System& system : systems)
+	{
+		system.total_ms = 0;
+		system.max_ms = 0;
+	}
+	frames = 0;
+	frame_ms = 0;
+	since_report_ms = 0;
+}
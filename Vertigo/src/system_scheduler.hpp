@@ -0,0 +1,108 @@
+#pragma once
+
+// stlib
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// internal
+#include "thread_pool.hpp"
+#include "tiny_ecs_registry.hpp"
+
+// The components a system reads and writes, as masks of the registry's component bits, e.g.
+//   SystemAccess().read<Player>().write<Motion, HoldTimer>()
+struct SystemAccess
+{
+	ComponentMask reads = 0;
+	ComponentMask writes = 0;
+	bool structural = false; // adds or removes components, which changes the entity masks shared by all containers
+	bool exclusive = false; // touches game state outside of the registry, runs on its own
+	bool main_thread = false; // calls into GLFW, the audio or anything else that only works on the main thread
+
+	template <typename... Components>
+	SystemAccess& read() { reads |= mask<Components...>(); return *this; }
+	template <typename... Components>
+	SystemAccess& write() { writes |= mask<Components...>(); return *this; }
+	SystemAccess& adds_or_removes() { structural = true; return *this; }
+	SystemAccess& on_main_thread() { main_thread = true; return *this; }
+
+	// Game state outside of the registry includes the window and the audio, so these run on the main thread too
+	static SystemAccess everything()
+	{
+		SystemAccess access;
+		access.exclusive = true;
+		access.main_thread = true;
+		return access;
+	}
+
+	// Two systems conflict if either writes what the other one touches
+	bool conflicts(const SystemAccess& other) const
+	{
+		return exclusive || other.exclusive || (structural && other.structural) ||
+			(writes & (other.reads | other.writes)) || (other.writes & reads);
+	}
+
+private:
+	template <typename... Components>
+	static ComponentMask mask()
+	{
+		ComponentMask bits = 0;
+		int expand[] = { 0, (bits |= ECSRegistry::mask_of<Components>(), 0)... };
+		(void)expand;
+		return bits;
+	}
+};
+
+// Runs the registered systems once per frame on a thread pool.
+// Every frame the systems are put into a dependency graph in which a system waits for all systems registered
+// before it that it conflicts with, see SystemAccess. Systems without conflicts run concurrently, conflicting
+// ones keep their registration order. Systems that need the main thread run on the thread calling run(), which
+// helps with the other systems in between. While reporting is on, the time spent in each system is printed every
+// report_interval_ms.
+class SystemScheduler
+{
+public:
+	explicit SystemScheduler(ThreadPool& pool) : pool(pool) {}
+
+	void add(const std::string& name, SystemAccess access, std::function<void(float)> run);
+
+	// Runs all systems and returns once they are done, must be called from the main thread
+	void run(float elapsed_ms);
+
+	bool reporting = false;
+	float report_interval_ms = 5000.f;
+
+private:
+	struct System
+	{
+		std::string name;
+		SystemAccess access;
+		std::function<void(float)> run;
+		std::vector<unsigned int> successors; // the systems that wait for this one
+		unsigned int dependencies = 0;
+		double total_ms = 0; // since the last report
+		double max_ms = 0;
+	};
+
+	void build_graph();
+	void schedule(unsigned int i, float elapsed_ms);
+	void run_system(unsigned int i, float elapsed_ms);
+	void report();
+
+	ThreadPool& pool;
+	std::vector<System> systems;
+	std::unique_ptr<std::atomic<unsigned int>[]> pending; // dependencies left this frame, per system
+	std::atomic<unsigned int> systems_left{ 0 }; // that haven't finished this frame
+	// Ready systems that wait for the main thread
+	std::mutex main_thread_mutex;
+	std::vector<unsigned int> main_thread_systems;
+
+	// Statistics since the last report
+	unsigned int frames = 0;
+	double frame_ms = 0;
+	float since_report_ms = 0;
+};
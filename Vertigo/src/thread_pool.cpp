@@ -0,0 +1,124 @@
+// internal
+#include "thread_pool.hpp"
+
+// stlib
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int worker_count)
+{
+	for (unsigned int i = 0; i < worker_count; i++)
+		workers.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	task_ready.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	task_ready.notify_one();
+	progress.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		if (!tasks.empty())
+			run_front(lock);
+		else if (running == 0)
+			return;
+		else
+			progress.wait(lock);
+	}
+}
+
+bool ThreadPool::run_one()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (tasks.empty())
+		return false;
+	run_front(lock);
+	return true;
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+	grain = std::max<size_t>(grain, 1);
+	const size_t ranges = (count + grain - 1) / grain;
+	if (ranges <= 1 || workers.empty())
+	{
+		if (count > 0)
+			fn(0, count);
+		return;
+	}
+
+	// Shared with the helper tasks, which may only get to run once all ranges are taken and this call returned.
+	// They don't touch fn then, the claimed range is past count.
+	struct Batch
+	{
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		size_t count;
+		size_t grain;
+		const std::function<void(size_t, size_t)>* fn;
+	};
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->count = count;
+	batch->grain = grain;
+	batch->fn = &fn;
+
+	auto run_ranges = [](Batch& batch) {
+		size_t begin;
+		while ((begin = batch.next.fetch_add(batch.grain)) < batch.count)
+		{
+			(*batch.fn)(begin, std::min(begin + batch.grain, batch.count));
+			batch.done.fetch_add(1, std::memory_order_release);
+		}
+	};
+	const size_t helpers = std::min<size_t>(workers.size(), ranges - 1);
+	for (size_t i = 0; i < helpers; i++)
+		submit([batch, run_ranges] { run_ranges(*batch); });
+	run_ranges(*batch);
+
+	// Only ranges that are already running are left, so this doesn't wait for unrelated tasks
+	while (batch->done.load(std::memory_order_acquire) < ranges)
+		std::this_thread::yield();
+}
+
+void ThreadPool::work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		task_ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+		if (stopping)
+			return;
+		run_front(lock);
+	}
+}
+
+void ThreadPool::run_front(std::unique_lock<std::mutex>& lock)
+{
+	std::function<void()> task = std::move(tasks.front());
+	tasks.pop_front();
+	running++;
+	lock.unlock();
+	task();
+	lock.lock();
+	running--;
+	if (running == 0 && tasks.empty())
+		progress.notify_all();
+}
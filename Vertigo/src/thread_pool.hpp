@@ -0,0 +1,51 @@
+#pragma once
+
+// stlib
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run submitted tasks in the order they were submitted.
+// The thread calling wait() helps with the queued tasks, so a pool without workers runs everything on it.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int worker_count);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// May be called from within a task
+	void submit(std::function<void()> task);
+
+	// Returns once the queue is empty and no task is running, tasks submitted meanwhile are waited for as well
+	void wait();
+
+	// Runs the next queued task on the calling thread, returns false if there was none
+	bool run_one();
+
+	// Splits [0, count) into ranges of grain elements and calls fn(begin, end) for each of them, on the workers
+	// and the calling thread. Returns once all ranges ran. Unlike wait() it only waits for its own ranges, so it
+	// may be called from within a task. Small counts (a single range) run in place.
+	void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+	unsigned int worker_count() const { return (unsigned int)workers.size(); }
+
+private:
+	void work();
+	// Runs the front task with the lock released, the lock must be held and the queue non-empty
+	void run_front(std::unique_lock<std::mutex>& lock);
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable task_ready; // wakes the workers
+	std::condition_variable progress; // wakes wait() on new tasks and when the pool ran dry
+	unsigned int running = 0;
+	bool stopping = false;
+};
@@ -5,48 +5,702 @@
 #include <unordered_map>
 #include <set>
 #include <functional>
+#include <tuple>
+#include <utility>
 #include <typeindex>
+#include <typeinfo>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
 #include <assert.h>
+#include "thread_pool.hpp"
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+// Plain data in and out of snapshot buffers, see TypedRegistry::save_snapshot. Values are copied bytewise, so
+// they must be trivially copyable, and read back in the order they were written. Arrays are stored at their
+// alignment (relative to the buffer, which new aligns for any fundamental type) so that they can be used in place.
+template <typename T>
+void snapshot_write(std::vector<char>& out, const T* values, size_t count)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Snapshots copy values bytewise");
+	static_assert(alignof(T) <= alignof(std::max_align_t), "Snapshot buffers are only aligned for fundamental types");
+	out.resize((out.size() + alignof(T) - 1) & ~(alignof(T) - 1));
+	const char* bytes = reinterpret_cast<const char*>(values);
+	out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+template <typename T>
+void snapshot_write(std::vector<char>& out, const T& value) { snapshot_write(out, &value, 1); }
+template <typename T>
+void snapshot_write(std::vector<char>& out, const std::vector<T>& values)
+{
+	snapshot_write(out, values.size());
+	snapshot_write(out, values.data(), values.size());
+}
+
+// The next count values, in place
+template <typename T>
+const T* snapshot_view(const char*& in, size_t count)
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Snapshots copy values bytewise");
+	in = reinterpret_cast<const char*>((reinterpret_cast<uintptr_t>(in) + alignof(T) - 1) & ~uintptr_t(alignof(T) - 1));
+	const T* values = reinterpret_cast<const T*>(in);
+	in += count * sizeof(T);
+	return values;
+}
+template <typename T>
+void snapshot_read(const char*& in, T* values, size_t count)
+{
+	std::memcpy(values, snapshot_view<T>(in, count), count * sizeof(T));
+}
+template <typename T>
+void snapshot_read(const char*& in, T& value) { snapshot_read(in, &value, 1); }
+template <typename T>
+void snapshot_read(const char*& in, std::vector<T>& values) // assigns instead of resizing, T needn't be default constructible
+{
+	size_t count;
+	snapshot_read(in, count);
+	const T* saved = snapshot_view<T>(in, count);
+	values.assign(saved, saved + count);
+}
+
+// Hands out entity ids and recycles the ones of destroyed entities.
+// An id packs an index (the low index_bits) and a generation (the remaining high bits). The generation of an
+// index is bumped whenever it is released, so handles that outlived their entity can be told apart from the
+// entity that re-uses the index.
+class EntityPool
+{
+	std::vector<unsigned int> generations; // current generation of each index, index 0 is the default initialization and never handed out
+	std::vector<unsigned int> free_indices;
+
+	// Ids created while the scope is open, see TypedRegistry::destroy_level_scope
+	std::vector<unsigned int> scope_ids;
+	bool scope_open = false;
+public:
+	enum : unsigned int {
+		index_bits = 20,
+		index_mask = (1u << index_bits) - 1,
+		generation_mask = (1u << (32 - index_bits)) - 1
+	};
+
+	EntityPool() : generations(1, 0) {}
+
+	unsigned int create()
+	{
+		unsigned int index;
+		if (!free_indices.empty())
+		{
+			index = free_indices.back();
+			free_indices.pop_back();
+		}
+		else
+		{
+			index = (unsigned int)generations.size();
+			assert(index <= index_mask && "Out of entity indices");
+			generations.push_back(0);
+		}
+		const unsigned int id = (generations[index] << index_bits) | index;
+		if (scope_open)
+			scope_ids.push_back(id);
+		return id;
+	}
+
+	// Makes the index of id available again, all existing handles to it become stale
+	void release(unsigned int id)
+	{
+		if (!alive(id))
+			return;
+		const unsigned int index = id & index_mask;
+		generations[index] = (generations[index] + 1) & generation_mask;
+		free_indices.push_back(index);
+	}
+
+	bool alive(unsigned int id) const
+	{
+		const unsigned int index = id & index_mask;
+		return index != 0 && index < generations.size() && generations[index] == (id >> index_bits);
+	}
+
+	// Number of indices handed out so far, live or free
+	size_t capacity() const { return generations.size(); }
+	// Number of indices waiting to be recycled
+	size_t free_count() const { return free_indices.size(); }
+
+	// Makes room for count more entities without reallocating
+	void reserve(size_t count)
+	{
+		generations.reserve(generations.size() + count);
+		if (scope_open)
+			scope_ids.reserve(scope_ids.size() + count);
+	}
+
+	// All entities created from now on are recorded until the scope is closed
+	void open_scope() { scope_open = true; }
+
+	// Closes the scope and hands out the ids created in it
+	std::vector<unsigned int> close_scope()
+	{
+		scope_open = false;
+		std::vector<unsigned int> ids;
+		ids.swap(scope_ids);
+		return ids;
+	}
+
+	// Appends the pool state to a snapshot
+	void save(std::vector<char>& out) const
+	{
+		snapshot_write(out, generations);
+		snapshot_write(out, free_indices);
+		snapshot_write(out, scope_ids);
+		snapshot_write(out, scope_open);
+	}
+
+	// Rolls back to a state written by save(). Entities alive back then get their handles back. Indices that
+	// were free become free again, with a new generation if they are in use now, so that handles created
+	// since the save go stale.
+	void load(const char*& in)
+	{
+		std::vector<unsigned int> saved_generations;
+		std::vector<unsigned int> saved_free;
+		snapshot_read(in, saved_generations);
+		snapshot_read(in, saved_free);
+		snapshot_read(in, scope_ids);
+		snapshot_read(in, scope_open);
+
+		const size_t count = std::max(generations.size(), saved_generations.size());
+		std::vector<unsigned char> was_free(count, 1), is_free(count, 1);
+		std::fill(was_free.begin() + 1, was_free.begin() + saved_generations.size(), (unsigned char)0);
+		std::fill(is_free.begin() + 1, is_free.begin() + generations.size(), (unsigned char)0);
+		for (unsigned int index : saved_free)
+			was_free[index] = 1;
+		for (unsigned int index : free_indices)
+			is_free[index] = 1;
+
+		generations.resize(count, 0);
+		for (unsigned int index = 1; index < count; index++)
+		{
+			if (!was_free[index])
+				generations[index] = saved_generations[index];
+			else
+			{
+				if (!is_free[index])
+					generations[index] = (generations[index] + 1) & generation_mask;
+				if (index >= saved_generations.size())
+					saved_free.push_back(index);
+			}
+		}
+		free_indices.swap(saved_free);
+	}
+};
 
 // Unique identifyer for all entities
 class Entity
 {
 	unsigned int id;
-	static unsigned int id_count; // starts from 1, entit 0 is the default initialization
+
+	struct raw_id {};
+	Entity(unsigned int id, raw_id) : id(id) {}
 public:
+	static EntityPool pool; // entity 0 is the default initialization and is never handed out
 	Entity()
 	{
-		id = id_count++;
-		// Note, indices of already deleted entities arent re-used in this simple implementation.
+		id = pool.create();
+		// Note, the index of a destroyed entity is re-used with a new generation, see EntityPool.
 	}
-	operator unsigned int() { return id; } // this enables automatic casting to int
+	// Rebuilds the handle of a raw id, for bookkeeping that stores plain ids (e.g. EntityPool scopes)
+	static Entity from_id(unsigned int id) { return Entity(id, raw_id()); }
+
+	unsigned int index() const { return id & EntityPool::index_mask; }
+	operator unsigned int() const { return id; } // this enables automatic casting to int
 };
 
+// One bit per component type of a TypedRegistry, set for every component an entity has
+typedef uint64_t ComponentMask;
+
 // Common interface to refer to all containers in the ECS registry
 struct ContainerInterface
 {
+	enum : unsigned int { npos = ~0u }; // returned by index_of() for entities that are not contained
 	virtual void clear() = 0;
 	virtual size_t size() = 0;
 	virtual void remove(Entity e) = 0;
 	virtual bool has(Entity entity) = 0;
+
+	// Pool that parallel_for_each() spreads over, set once at startup. Without one the loops run on the calling thread.
+	static ThreadPool* workers;
 };
 
-// A container that stores components of type 'Component' and associated entities
-template <typename Component> // A component can be any class
-class ComponentContainer : public ContainerInterface
+// Entity -> array index lookup backed by a hash map.
+// This was the original storage; it is kept around to compare against the sparse set below.
+class HashEntityIndex
 {
-private:
-	// The hash map from Entity -> array index.
 	std::unordered_map<unsigned int, unsigned int> map_entity_componentID; // the entity is cast to uint to be hashable.
-	bool registered = false;
 public:
-	// Container of all components of type 'Component'
-	std::vector<Component> components;
+	enum : unsigned int { npos = ~0u }; // returned by find() for entities without an entry
+
+	unsigned int find(unsigned int id) const
+	{
+		auto it = map_entity_componentID.find(id);
+		return it == map_entity_componentID.end() ? npos : it->second;
+	}
+	void set(unsigned int id, unsigned int index) { map_entity_componentID[id] = index; }
+	void erase(unsigned int id) { map_entity_componentID.erase(id); }
+	void reserve(size_t entries, size_t) { map_entity_componentID.reserve(entries); }
+	void clear() { map_entity_componentID.clear(); }
+
+	// For ContainerStats: the hash map's load factor and an estimate of its memory (buckets plus one node per entry)
+	double load(size_t) const { return map_entity_componentID.load_factor(); }
+	size_t bytes() const
+	{
+		return map_entity_componentID.bucket_count() * sizeof(void*)
+			+ map_entity_componentID.size() * (sizeof(std::pair<const unsigned int, unsigned int>) + 2 * sizeof(void*));
+	}
+};
+
+// Entity -> array index lookup backed by a paged sparse array (the sparse half of a sparse set).
+// Entity ids index directly into fixed size pages, so a lookup is a shift, a mask and one load instead of a hash probe.
+// Pages are only allocated once an entity in their range gets the component, which keeps containers
+// of rarely used components small even though entity ids keep growing.
+class SparseEntityIndex
+{
+	enum : unsigned int { page_bits = 10, page_size = 1u << page_bits, page_mask = page_size - 1 };
 
-	// The corresponding entities
+	std::vector<std::vector<unsigned int>> pages; // an empty page has not been allocated yet
+public:
+	enum : unsigned int { npos = ~0u }; // returned by find() for entities without an entry
+
+	unsigned int find(unsigned int id) const
+	{
+		const size_t page = id >> page_bits;
+		if (page >= pages.size() || pages[page].empty())
+			return npos;
+		return pages[page][id & page_mask];
+	}
+	void set(unsigned int id, unsigned int index)
+	{
+		const size_t page = id >> page_bits;
+		if (page >= pages.size())
+			pages.resize(page + 1);
+		if (pages[page].empty())
+			pages[page].assign(page_size, npos);
+		pages[page][id & page_mask] = index;
+	}
+	void erase(unsigned int id)
+	{
+		const size_t page = id >> page_bits;
+		if (page < pages.size() && !pages[page].empty())
+			pages[page][id & page_mask] = npos;
+	}
+	// Keeps the pages, a container that was reserved for a level stays reserved when it is cleared for the next
+	void clear()
+	{
+		for (std::vector<unsigned int>& page : pages)
+			std::fill(page.begin(), page.end(), npos);
+	}
+
+	// For ContainerStats: the share of the allocated slots that are in use, and the memory of the pages
+	double load(size_t entries) const
+	{
+		const size_t slots = allocated_pages() * page_size;
+		return slots > 0 ? double(entries) / slots : 0.0;
+	}
+	size_t bytes() const { return pages.capacity() * sizeof(pages[0]) + allocated_pages() * page_size * sizeof(unsigned int); }
+	size_t allocated_pages() const
+	{
+		size_t count = 0;
+		for (const std::vector<unsigned int>& page : pages)
+			count += !page.empty();
+		return count;
+	}
+
+	// Allocates the pages of all ids below max_id up front
+	void reserve(size_t, size_t max_id)
+	{
+		const size_t page_count = (max_id + page_size - 1) >> page_bits;
+		if (page_count > pages.size())
+			pages.resize(page_count);
+		for (std::vector<unsigned int>& page : pages)
+			if (page.empty())
+				page.assign(page_size, npos);
+	}
+};
+
+// Readable name of a type for debug output, typeid names are mangled with GCC and Clang
+inline std::string type_name(const std::type_info& type)
+{
+#if defined(__GNUG__)
+	int status = 0;
+	char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+	if (status == 0 && demangled)
+	{
+		std::string name(demangled);
+		std::free(demangled);
+		return name;
+	}
+#endif
+	return type.name();
+}
+
+// Memory and usage of one container, see TypedRegistry::stats()
+// Bytes are the container's own arrays and index, memory owned by the components themselves is not followed.
+// The operation counts are since the last reset_stats(), they are left out when built with ECS_NO_OP_COUNTS.
+struct ContainerStats
+{
+	std::string name;
+	size_t size = 0; // components
+	size_t capacity = 0; // components that fit without reallocating
+	size_t bytes = 0;
+	double index_load = 0; // HashEntityIndex: load factor, SparseEntityIndex: share of the allocated slots in use
+	unsigned long long gets = 0; // get() and read()
+	unsigned long long has = 0;
+	unsigned long long inserts = 0;
+	unsigned long long removes = 0;
+};
+
+// Bookkeeping shared by the component storages below: the dense entities array, the EntityIndex that maps
+// entities to their position in it, the registry's component masks and change tracking.
+// Storage is the derived container, it keeps its component data at the same positions as entities and
+// provides move_data(to, from), pop_data() and clear_data() to follow removals, reserve_data(n), as well as
+// save_data(out) and load_data(in, count) for snapshots, and data_capacity() and data_bytes() for stats().
+template <class Storage, typename EntityIndex>
+class DenseStorage : public ContainerInterface
+{
+protected:
+	// The lookup from Entity -> array index.
+	EntityIndex entity_index;
+
+	// Change tracking: the version goes up with every change, the dirty flags (parallel to entities) are only
+	// kept once track_changes(true) was called. Mutable get() counts as a change while tracking.
+	std::atomic<unsigned int> change_version{ 0 };
+	std::vector<unsigned char> dirty;
+	bool tracking = false;
+	// Goes up whenever the positions in the dense arrays change, not for writes
+	unsigned int layout_changes = 0;
+
+	void changed() { change_version.fetch_add(1, std::memory_order_relaxed); }
+	void layout_changed()
+	{
+		layout_changes++;
+		changed();
+	}
+	void changed_all()
+	{
+		changed();
+		if (tracking)
+			std::fill(dirty.begin(), dirty.end(), (unsigned char)1);
+	}
+
+	// The per entity component masks of the registry this container is registered with, see TypedRegistry
+	std::vector<ComponentMask>* masks = nullptr;
+	ComponentMask mask_bit = 0;
+
+	void set_mask_bit(Entity e)
+	{
+		if (!masks)
+			return;
+		if (e.index() >= masks->size())
+			masks->resize(e.index() + 1, 0);
+		(*masks)[e.index()] |= mask_bit;
+	}
+	void clear_mask_bit(Entity e)
+	{
+		if (masks)
+			(*masks)[e.index()] &= ~mask_bit;
+	}
+
+	// Operation counts for stats(). Systems on different threads may read the same container, hence relaxed atomics.
+	struct OpCounts
+	{
+		std::atomic<unsigned long long> gets{ 0 }, has{ 0 }, inserts{ 0 }, removes{ 0 };
+	};
+	mutable OpCounts op_counts;
+	static void count(std::atomic<unsigned long long>& counter)
+	{
+#ifndef ECS_NO_OP_COUNTS
+		counter.fetch_add(1, std::memory_order_relaxed);
+#else
+		(void)counter;
+#endif
+	}
+
+	// Appends e, the storage pushes the component data at the returned position
+	unsigned int add_entity(Entity e, bool check_for_duplicates)
+	{
+		// Usually, every entity should only have one instance of each component type
+		assert(!(check_for_duplicates && index_of(e) != npos) && "Entity already contained in ECS registry");
+
+		assert(Entity::pool.alive(e) && "Stale entity handle");
+		count(op_counts.inserts);
+
+		const unsigned int cID = (unsigned int)entities.size();
+		entity_index.set(e.index(), cID);
+		entities.push_back(e);
+		set_mask_bit(e);
+		if (tracking)
+			dirty.push_back(1);
+		layout_changed();
+		return cID;
+	}
+
+	// Position of e for writing, marks it as changed if the container tracks changes
+	unsigned int write_index(Entity e)
+	{
+		assert(Entity::pool.alive(e) && "Stale entity handle");
+		assert(index_of(e) != npos && "Entity not contained in ECS registry");
+		count(op_counts.gets);
+		const unsigned int cID = entity_index.find(e.index());
+		if (tracking)
+		{
+			dirty[cID] = 1;
+			changed();
+		}
+		return cID;
+	}
+
+	// Position of e for reading, which doesn't count as a change
+	unsigned int read_index(Entity e) const
+	{
+		assert(Entity::pool.alive(e) && "Stale entity handle");
+		assert(index_of(e) != npos && "Entity not contained in ECS registry");
+		count(op_counts.gets);
+		return entity_index.find(e.index());
+	}
+public:
+	// The entities, in the same order as the components
 	std::vector<Entity> entities;
 
-	// Constructor that registers the type
+	// Registers the container with a registry, which then tracks the component through the given bit of the entity masks
+	void register_masks(std::vector<ComponentMask>* entity_masks, ComponentMask bit)
+	{
+		masks = entity_masks;
+		mask_bit = bit;
+	}
+
+	// Turns the dirty flags on or off, all components start out dirty
+	void track_changes(bool enable)
+	{
+		tracking = enable;
+		dirty.assign(enable ? entities.size() : 0, 1);
+	}
+	bool tracks_changes() const { return tracking; }
+
+	// Goes up whenever a component is added, removed, reordered or (while tracking) handed out for writing.
+	// Consumers remember the version they last saw to find out whether anything changed at all.
+	unsigned int version() const { return change_version.load(std::memory_order_relaxed); }
+	// Only goes up when components are added, removed or reordered, e.g. for lookups by position
+	unsigned int layout_version() const { return layout_changes; }
+
+	// Per component dirty flags, only meaningful while tracking
+	bool is_dirty(Entity e) const
+	{
+		const unsigned int cID = index_of(e);
+		return tracking && cID != npos && dirty[cID];
+	}
+	bool is_dirty_at(unsigned int cID) const { return tracking && dirty[cID]; }
+
+	// For writes that bypass get(), e.g. loops over the components array
+	void mark_dirty_at(unsigned int cID)
+	{
+		if (tracking)
+			dirty[cID] = 1;
+		changed();
+	}
+	void mark_dirty(Entity e)
+	{
+		const unsigned int cID = index_of(e);
+		if (cID != npos)
+			mark_dirty_at(cID);
+	}
+	void mark_all_dirty() { changed_all(); }
+
+	// Called by the consumer once it has caught up with the changes
+	void clear_dirty() { std::fill(dirty.begin(), dirty.end(), (unsigned char)0); }
+
+	// Position of the entity in the components/entities arrays, or npos if it has no such component
+	// The index is shared by all generations of an entity, so the stored handle has to match as well.
+	unsigned int index_of(Entity entity) const {
+		const unsigned int cID = entity_index.find(entity.index());
+		return (cID != EntityIndex::npos && entities[cID] == entity) ? cID : (unsigned int)npos;
+	}
+
+	// Check if entity has a component of type 'Component'
+	bool has(Entity entity) {
+		count(op_counts.has);
+		return index_of(entity) != npos;
+	}
+
+	// Remove an component and pack the container to re-use the empty space
+	void remove(Entity e)
+	{
+		count(op_counts.removes);
+		if (index_of(e) == npos)
+			return;
+		const unsigned int cID = entity_index.find(e.index());
+		Storage& storage = static_cast<Storage&>(*this);
+
+		// Move the last element to position cID
+		if (cID != entities.size() - 1)
+		{
+			storage.move_data(cID, (unsigned int)entities.size() - 1);
+			entities[cID] = entities.back(); // the entity is only a single index, copy it.
+			entity_index.set(entities[cID].index(), cID);
+			if (tracking)
+				dirty[cID] = dirty.back();
+		}
+		if (tracking)
+			dirty.pop_back();
+		layout_changed();
+
+		// Erase the old component and free its memory
+		entity_index.erase(e.index());
+		clear_mask_bit(e);
+		storage.pop_data();
+		entities.pop_back();
+	};
+
+	// Remove all components of type 'Component'
+	void clear()
+	{
+		for (Entity e : entities)
+			clear_mask_bit(e);
+		entity_index.clear();
+		static_cast<Storage&>(*this).clear_data();
+		entities.clear();
+		dirty.clear();
+		layout_changed();
+	}
+
+	// Report the number of components of type 'Component'
+	size_t size()
+	{
+		return entities.size();
+	}
+
+	// Makes room for n components, for containers that are about to be filled, e.g. while loading a level.
+	// The index is prepared for the ids of the entities that exist plus n new ones.
+	void reserve(size_t n)
+	{
+		entities.reserve(n);
+		if (tracking)
+			dirty.reserve(n);
+		entity_index.reserve(n, Entity::pool.capacity() + n);
+		static_cast<Storage&>(*this).reserve_data(n);
+	}
+
+	// Calls fn(begin, end) for consecutive ranges of about grain positions of the dense arrays, spread over the
+	// workers. Ranges don't overlap, but fn must not add or remove components, nor touch other entities' data.
+	// All components count as changed, like for any write that bypasses get().
+	template <typename Fn>
+	void parallel_for_ranges(Fn fn, size_t grain = 1024)
+	{
+		if (entities.empty())
+			return;
+		changed_all();
+		if (!workers)
+			fn(size_t(0), entities.size());
+		else
+			workers->parallel_for(entities.size(), grain, fn);
+	}
+
+	// Calls fn(entity, component) for every component, see parallel_for_ranges
+	template <typename Fn>
+	void parallel_for_each(Fn fn, size_t grain = 1024)
+	{
+		Storage& storage = static_cast<Storage&>(*this);
+		parallel_for_ranges([&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				fn(entities[i], storage.at((unsigned int)i));
+		}, grain);
+	}
+
+	// Size, memory and operation counts of the container, the name is left to the registry
+	ContainerStats stats()
+	{
+		Storage& storage = static_cast<Storage&>(*this);
+		ContainerStats stats;
+		stats.size = entities.size();
+		stats.capacity = storage.data_capacity();
+		stats.bytes = entities.capacity() * sizeof(Entity) + dirty.capacity() + storage.data_bytes() + entity_index.bytes();
+		stats.index_load = entity_index.load(entities.size());
+		stats.gets = op_counts.gets.load(std::memory_order_relaxed);
+		stats.has = op_counts.has.load(std::memory_order_relaxed);
+		stats.inserts = op_counts.inserts.load(std::memory_order_relaxed);
+		stats.removes = op_counts.removes.load(std::memory_order_relaxed);
+		return stats;
+	}
+	void reset_stats()
+	{
+		op_counts.gets.store(0, std::memory_order_relaxed);
+		op_counts.has.store(0, std::memory_order_relaxed);
+		op_counts.inserts.store(0, std::memory_order_relaxed);
+		op_counts.removes.store(0, std::memory_order_relaxed);
+	}
+
+	// Appends entities and components to a snapshot, see TypedRegistry::save_snapshot
+	void save_snapshot(std::vector<char>& out)
+	{
+		snapshot_write(out, entities);
+		static_cast<Storage&>(*this).save_data(out);
+	}
+
+	// Replaces the contents with the ones written by save_snapshot(), all of them count as changed.
+	// The masks are left to the registry, which restores them for all containers at once.
+	void restore_snapshot(const char*& in)
+	{
+		snapshot_read(in, entities);
+		static_cast<Storage&>(*this).load_data(in, entities.size());
+		entity_index.clear();
+		for (unsigned int i = 0; i < entities.size(); i++)
+			entity_index.set(entities[i].index(), i);
+		dirty.assign(tracking ? entities.size() : 0, 1);
+		layout_changed();
+	}
+};
+
+// A container that stores components of type 'Component' and associated entities
+// The EntityIndex maps entities to their position in the dense components/entities arrays, see above.
+template <typename Component, typename EntityIndex = SparseEntityIndex> // A component can be any class
+class ComponentContainer final : public DenseStorage<ComponentContainer<Component, EntityIndex>, EntityIndex>
+{
+	typedef DenseStorage<ComponentContainer, EntityIndex> Base;
+	friend Base;
+	using Base::entity_index;
+	using Base::layout_changed;
+	using Base::dirty;
+	using Base::tracking;
+
+	void move_data(unsigned int to, unsigned int from)
+	{
+		// Note, components[to] = components[from] would trigger the copy instead of move operator
+		components[to] = std::move(components[from]);
+	}
+	void pop_data() { components.pop_back(); }
+	void clear_data() { components.clear(); }
+	void reserve_data(size_t n) { components.reserve(n); }
+	size_t data_capacity() const { return components.capacity(); }
+	size_t data_bytes() const { return components.capacity() * sizeof(Component) + order.capacity() * sizeof(unsigned int); }
+	void save_data(std::vector<char>& out) { snapshot_write(out, components.data(), components.size()); }
+	void load_data(const char*& in, size_t count)
+	{
+		const Component* saved = snapshot_view<Component>(in, count);
+		components.assign(saved, saved + count);
+	}
+public:
+	using Base::entities;
+
+	// What get() and views hand out
+	typedef Component& Ref;
+
+	// Container of all components of type 'Component'
+	std::vector<Component> components;
+
 	ComponentContainer()
 	{
 	}
@@ -54,12 +708,8 @@ public:
 	// Inserting a component c associated to entity e
 	inline Component& insert(Entity e, Component c, bool check_for_duplicates = true)
 	{
-		// Usually, every entity should only have one instance of each component type
-		assert(!(check_for_duplicates && has(e)) && "Entity already contained in ECS registry");
-
-		map_entity_componentID[e] = (unsigned int)components.size();
+		this->add_entity(e, check_for_duplicates);
 		components.push_back(std::move(c)); // the move enforces move instead of copy constructor
-		entities.push_back(e);
 		return components.back();
 	};
 
@@ -73,65 +723,597 @@ public:
 		return insert(e, Component(std::forward<Args>(args)...), false);
 	};
 
-	// A wrapper to return the component of an entity
+	// A wrapper to return the component of an entity, marks it as changed if the container tracks changes
 	Component& get(Entity e) {
-		assert(has(e) && "Entity not contained in ECS registry");
-		return components[map_entity_componentID[e]];
+		return components[this->write_index(e)];
 	}
 
-	// Check if entity has a component of type 'Component'
-	bool has(Entity entity) {
-		return map_entity_componentID.count(entity) > 0;
+	// Read-only access, which doesn't count as a change
+	const Component& read(Entity e) const {
+		return components[this->read_index(e)];
 	}
 
-	// Remove an component and pack the container to re-use the empty space
-	void remove(Entity e)
+	// The component at position cID of the dense arrays
+	Component& at(unsigned int cID) { return components[cID]; }
+
+	// Sort the components and associated entity assignment structures by the comparisonFunction, see std::sort
+	template <class Compare>
+	void sort(Compare comparisonFunction)
+	{
+		// Sort positions instead of the entities, so that the components can follow in place afterwards
+		order.resize(entities.size());
+		for (unsigned int i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return comparisonFunction(entities[a], entities[b]); });
+		permute(order);
+	}
+	// Re-sorts by key(component) with an insertion sort, which is linear for data that is already (almost) in order.
+	// Meant for containers that are kept sorted every frame, e.g. renderRequests. Returns whether anything moved.
+	// Moving a component doesn't change it, its dirty flag moves along.
+	template <class KeyFunction>
+	bool sort_by_key(KeyFunction key)
 	{
-		if (has(e))
+		unsigned int first_moved = (unsigned int)components.size();
+		for (unsigned int i = 1; i < components.size(); i++)
 		{
-			// Get the current position
-			int cID = map_entity_componentID[e];
+			if (!(key(components[i]) < key(components[i - 1])))
+				continue;
 
-			// Move the last element to position cID using the move operator
-			// Note, components[cID] = components.back() would trigger the copy instead of move operator
-			components[cID] = std::move(components.back());
-			entities[cID] = entities.back(); // the entity is only a single index, copy it.
-			map_entity_componentID[entities.back()] = cID;
+			Component component = std::move(components[i]);
+			Entity entity = entities[i];
+			const unsigned char was_dirty = tracking ? dirty[i] : 0;
+			const auto component_key = key(component);
+			unsigned int j = i;
+			for (; j > 0 && component_key < key(components[j - 1]); j--)
+			{
+				components[j] = std::move(components[j - 1]);
+				entities[j] = entities[j - 1];
+				if (tracking)
+					dirty[j] = dirty[j - 1];
+			}
+			components[j] = std::move(component);
+			entities[j] = entity;
+			if (tracking)
+				dirty[j] = was_dirty;
+			first_moved = std::min(first_moved, j);
+		}
 
-			// Erase the old component and free its memory
-			map_entity_componentID.erase(e);
-			components.pop_back();
-			entities.pop_back();
-			// Note, one could mark the id for re-use
+		for (unsigned int i = first_moved; i < entities.size(); i++)
+			entity_index.set(entities[i].index(), i);
+		if (first_moved < components.size())
+			layout_changed();
+		return first_moved < components.size();
+	}
+
+private:
+	// Scratch space of sort(), kept so that sorting doesn't allocate once it has reached its size
+	std::vector<unsigned int> order;
+
+	// Moves the element at order[i] to position i for all i, following each cycle of the permutation once so
+	// that every element is moved a single time, together with its dirty flag. Overwrites order.
+	void permute(std::vector<unsigned int>& order)
+	{
+		for (unsigned int i = 0; i < order.size(); i++)
+		{
+			if (order[i] == i)
+				continue;
+
+			Component component = std::move(components[i]);
+			Entity entity = entities[i];
+			const unsigned char was_dirty = tracking ? dirty[i] : 0;
+			unsigned int j = i;
+			while (order[j] != i)
+			{
+				const unsigned int next = order[j];
+				components[j] = std::move(components[next]);
+				entities[j] = entities[next];
+				if (tracking)
+					dirty[j] = dirty[next];
+				order[j] = j; // done
+				j = next;
+			}
+			components[j] = std::move(component);
+			entities[j] = entity;
+			if (tracking)
+				dirty[j] = was_dirty;
+			order[j] = j;
 		}
+
+		for (unsigned int i = 0; i < entities.size(); i++)
+			entity_index.set(entities[i].index(), i);
+		layout_changed();
+	}
+};
+
+// Growable array of trivially copyable values whose storage starts on an Alignment byte boundary,
+// used for the field arrays of SoAContainer so that passes over a field start on a cache line
+template <typename T, size_t Alignment = 64>
+class AlignedArray
+{
+	static_assert(std::is_trivially_copyable<T>::value, "AlignedArray moves its values with memcpy");
+	static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+
+	void* block = nullptr; // the allocation, values points into it
+	T* values = nullptr;
+	size_t count = 0;
+	size_t allocated = 0;
+public:
+	typedef T value_type;
+
+	AlignedArray() {}
+	~AlignedArray() { std::free(block); }
+	AlignedArray(const AlignedArray&) = delete;
+	AlignedArray& operator=(const AlignedArray&) = delete;
+
+	void reserve(size_t n)
+	{
+		if (n <= allocated)
+			return;
+		void* new_block = std::malloc(n * sizeof(T) + Alignment);
+		assert(new_block && "Out of memory");
+		T* new_values = reinterpret_cast<T*>((reinterpret_cast<uintptr_t>(new_block) + Alignment - 1) & ~uintptr_t(Alignment - 1));
+		if (count > 0)
+			std::memcpy(new_values, values, count * sizeof(T));
+		std::free(block);
+		block = new_block;
+		values = new_values;
+		allocated = n;
+	}
+	void push_back(const T& value)
+	{
+		if (count == allocated)
+			reserve(allocated > 0 ? allocated * 2 : 64);
+		new (values + count++) T(value);
+	}
+	void pop_back() { count--; }
+	void clear() { count = 0; }
+	void resize(size_t n) // new values are left uninitialized
+	{
+		reserve(n);
+		count = n;
+	}
+
+	size_t size() const { return count; }
+	size_t capacity() const { return allocated; }
+	T* data() { return values; }
+	const T* data() const { return values; }
+	T& operator[](size_t i) { return values[i]; }
+	const T& operator[](size_t i) const { return values[i]; }
+};
+
+// A container with the same entity indexing as ComponentContainer that keeps every member of the component
+// in its own AlignedArray (structure of arrays), for hot components whose systems only touch a few members.
+// Fields describes the split and holds the arrays, which are public through inheritance:
+//   typedef ... Component;              the component type
+//   typedef ... Ref;                    proxy with a reference per member, handed out by get() and views
+//   Ref at(unsigned int cID);           references into the arrays at cID
+//   Component load(unsigned int cID) const;
+//   void push_back(const Component& c);
+//   template <class Fn> void for_each_field(Fn fn);  calls fn(array) for every field array
+// See MotionFields for an example, a component opts in by specializing ComponentStorage.
+template <class Fields, typename EntityIndex = SparseEntityIndex>
+class SoAContainer final : public DenseStorage<SoAContainer<Fields, EntityIndex>, EntityIndex>, public Fields
+{
+	typedef DenseStorage<SoAContainer, EntityIndex> Base;
+	friend Base;
+
+	void move_data(unsigned int to, unsigned int from) { this->for_each_field([=](auto& field) { field[to] = field[from]; }); }
+	void pop_data() { this->for_each_field([](auto& field) { field.pop_back(); }); }
+	void clear_data() { this->for_each_field([](auto& field) { field.clear(); }); }
+	void reserve_data(size_t n) { this->for_each_field([=](auto& field) { field.reserve(n); }); }
+	size_t data_capacity()
+	{
+		size_t capacity = SIZE_MAX;
+		this->for_each_field([&](auto& field) { capacity = std::min(capacity, field.capacity()); });
+		return capacity;
+	}
+	size_t data_bytes()
+	{
+		size_t bytes = 0;
+		this->for_each_field([&](auto& field) { bytes += field.capacity() * sizeof(typename std::decay_t<decltype(field)>::value_type); });
+		return bytes;
+	}
+	void save_data(std::vector<char>& out) { this->for_each_field([&](auto& field) { snapshot_write(out, field.data(), field.size()); }); }
+	void load_data(const char*& in, size_t count)
+	{
+		this->for_each_field([&](auto& field) {
+			field.resize(count);
+			snapshot_read(in, field.data(), count);
+		});
+	}
+public:
+	typedef typename Fields::Component Component;
+	typedef typename Fields::Ref Ref;
+
+	Ref insert(Entity e, const Component& c, bool check_for_duplicates = true)
+	{
+		const unsigned int cID = this->add_entity(e, check_for_duplicates);
+		Fields::push_back(c);
+		return Fields::at(cID);
+	}
+
+	template<typename... Args>
+	Ref emplace(Entity e, Args &&... args) {
+		return insert(e, Component(std::forward<Args>(args)...));
+	};
+	template<typename... Args>
+	Ref emplace_with_duplicates(Entity e, Args &&... args) {
+		return insert(e, Component(std::forward<Args>(args)...), false);
 	};
 
-	// Remove all components of type 'Component'
-	void clear()
+	// References to the fields of e, marks it as changed if the container tracks changes
+	Ref get(Entity e) {
+		return Fields::at(this->write_index(e));
+	}
+
+	// A copy of the component, which doesn't count as a change
+	Component read(Entity e) const {
+		return Fields::load(this->read_index(e));
+	}
+};
+
+// The container a registry keeps for Component, specialize to opt a component into another storage
+template <typename Component>
+struct ComponentStorageFor { typedef ComponentContainer<Component> type; };
+template <typename Component>
+using ComponentStorage = typename ComponentStorageFor<Component>::type;
+
+// Iterates over all entities that have every one of the Components.
+// The smallest container drives the iteration and the other ones are only probed through their sparse index,
+// the callback receives the entity followed by references to its components (the Ref proxy for SoA storage), e.g.
+//   registry.view<Enemy, Object>().each([](Entity e, Enemy& enemy, Object& object) { ... });
+// Components may be modified in the callback, but don't add or remove components of the viewed types.
+template <typename... Components>
+class View
+{
+	std::tuple<ComponentStorage<Components>&...> containers;
+
+	template <typename Fn, size_t... I>
+	void each(Fn& fn, std::index_sequence<I...>)
 	{
-		map_entity_componentID.clear();
-		components.clear();
-		entities.clear();
+		const std::vector<Entity>* lists[] = { &std::get<I>(containers).entities... };
+		const std::vector<Entity>* driver = lists[0];
+		for (const std::vector<Entity>* list : lists)
+			if (list->size() < driver->size())
+				driver = list;
+
+		for (size_t i = 0; i < driver->size(); i++)
+		{
+			const Entity e = (*driver)[i];
+			const unsigned int index[] = { std::get<I>(containers).index_of(e)... };
+			bool matches = true;
+			for (unsigned int cID : index)
+				matches &= cID != ContainerInterface::npos;
+			if (matches)
+				fn(e, std::get<I>(containers).at(index[I])...);
+		}
 	}
+public:
+	View(ComponentStorage<Components>&... containers) : containers(containers...) {}
 
-	// Report the number of components of type 'Component'
-	size_t size()
+	template <typename Fn>
+	void each(Fn fn)
 	{
-		return components.size();
+		each(fn, std::index_sequence_for<Components...>());
 	}
+};
 
-	// Sort the components and associated entity assignment structures by the comparisonFunction, see std::sort
-	template <class Compare>
-	void sort(Compare comparisonFunction)
+// Position of type T in the list Ts
+template <typename T, typename... Ts> struct type_index_of;
+template <typename T, typename... Ts> struct type_index_of<T, T, Ts...> : std::integral_constant<unsigned int, 0> {};
+template <typename T, typename U, typename... Ts> struct type_index_of<T, U, Ts...> : std::integral_constant<unsigned int, 1 + type_index_of<T, Ts...>::value> {};
+
+// Index of the lowest set bit, mask must not be 0
+inline unsigned int lowest_bit(ComponentMask mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int)__builtin_ctzll(mask);
+#else
+	unsigned int bit = 0;
+	while (!(mask & 1)) { mask >>= 1; bit++; }
+	return bit;
+#endif
+}
+
+// A registry holding one container for every type in Components.
+// Each entity has a ComponentMask with the bits of the containers it is in, so removing an entity only visits
+// those containers. Containers are resolved at compile time, a component type without container doesn't compile.
+template <typename... Components>
+class TypedRegistry
+{
+	static_assert(sizeof...(Components) <= 64, "ComponentMask has one bit per component type");
+
+	std::tuple<ComponentStorage<Components>...> containers;
+	std::vector<ComponentMask> masks; // indexed by Entity::index()
+
+	typedef void (*Remover)(TypedRegistry&, Entity);
+	template <typename Component>
+	static void remove_component(TypedRegistry& registry, Entity e) { registry.container<Component>().remove(e); }
+
+	template <typename Fn, size_t... I>
+	void for_each_container(Fn& fn, std::index_sequence<I...>)
 	{
-		// First sort the entity list as desired
-		std::sort(entities.begin(), entities.end(), comparisonFunction);
-		// Now re-arrange the components (Note, creates a new vector, which may be slow! Not sure if in-place could be faster: https://stackoverflow.com/questions/63703637/how-to-efficiently-permute-an-array-in-place-using-stdswap)
-		std::vector<Component> components_new; components_new.reserve(components.size());
-		std::transform(entities.begin(), entities.end(), std::back_inserter(components_new), [&](Entity e) { return std::move(get(e)); }); // note, the get still uses the old hash map (on purpose!)
-		components = std::move(components_new); // note, we use move operations to not create unneccesary copies of objects, but memory is still allocated for the new vector
-		// Fill the new hashmap
-		for (unsigned int i = 0; i < entities.size(); i++)
-			map_entity_componentID[entities[i]] = i;
+		int expand[] = { 0, (fn(std::get<I>(containers)), 0)... };
+		(void)expand;
+	}
+public:
+	// Records structural changes (emplace, remove, destroy) so that systems can keep iterating the dense arrays
+	// while they decide on them. Nothing happens to the containers until flush(), which applies the changes in
+	// the order they were recorded. Changes to entities that got destroyed in the meantime are dropped.
+	class CommandBuffer
+	{
+		enum class Op : unsigned char { EMPLACE, REMOVE, DESTROY };
+		struct Command
+		{
+			Op op;
+			unsigned char type; // position of the component in Components
+			unsigned int slot; // position of the emplaced value in its pending vector
+			Entity e;
+		};
+
+		typedef void (*Apply)(TypedRegistry&, std::tuple<std::vector<Components>...>&, const Command&);
+		template <typename Component>
+		static void apply_emplace(TypedRegistry& registry, std::tuple<std::vector<Components>...>& pending, const Command& command)
+		{
+			registry.container<Component>().insert(command.e, std::move(std::get<std::vector<Component>>(pending)[command.slot]));
+		}
+		template <typename Component>
+		static void apply_remove(TypedRegistry& registry, std::tuple<std::vector<Components>...>&, const Command& command)
+		{
+			registry.container<Component>().remove(command.e);
+		}
+
+		TypedRegistry& registry;
+		std::vector<Command> commands;
+		std::tuple<std::vector<Components>...> pending; // emplaced values, kept to re-use their memory
+	public:
+		CommandBuffer(TypedRegistry& registry) : registry(registry) {}
+
+		// The handle is valid right away, its components only show up after the flush
+		Entity create() { return Entity(); }
+
+		template <typename Component, typename... Args>
+		void emplace(Entity e, Args&&... args)
+		{
+			std::vector<Component>& values = std::get<std::vector<Component>>(pending);
+			commands.push_back({ Op::EMPLACE, (unsigned char)type_index_of<Component, Components...>::value, (unsigned int)values.size(), e });
+			values.push_back(Component(std::forward<Args>(args)...));
+		}
+
+		template <typename Component>
+		void remove(Entity e)
+		{
+			commands.push_back({ Op::REMOVE, (unsigned char)type_index_of<Component, Components...>::value, 0, e });
+		}
+
+		void destroy(Entity e)
+		{
+			commands.push_back({ Op::DESTROY, 0, 0, e });
+		}
+
+		bool empty() const { return commands.empty(); }
+
+		// Drops all recorded changes
+		void clear()
+		{
+			commands.clear();
+			int expand[] = { 0, (std::get<std::vector<Components>>(pending).clear(), 0)... };
+			(void)expand;
+		}
+
+		// The sync point: applies all recorded changes
+		void flush()
+		{
+			static const Apply emplacers[] = { &apply_emplace<Components>... };
+			static const Apply removers[] = { &apply_remove<Components>... };
+			for (const Command& command : commands)
+			{
+				if (!registry.alive(command.e))
+					continue;
+				switch (command.op)
+				{
+				case Op::EMPLACE: emplacers[command.type](registry, pending, command); break;
+				case Op::REMOVE: removers[command.type](registry, pending, command); break;
+				case Op::DESTROY: registry.destroy(command.e); break;
+				}
+			}
+			clear();
+		}
+	};
+	CommandBuffer commands{ *this };
+
+	TypedRegistry()
+	{
+		unsigned int bit = 0;
+		for_each_container([&](auto& container) { container.register_masks(&masks, ComponentMask(1) << bit++); });
+	}
+	TypedRegistry(const TypedRegistry&) = delete; // the containers point back at masks
+	TypedRegistry& operator=(const TypedRegistry&) = delete;
+
+	template <typename Component>
+	ComponentStorage<Component>& container() { return std::get<ComponentStorage<Component>>(containers); }
+
+	template <typename Component>
+	static ComponentMask mask_of() { return ComponentMask(1) << type_index_of<Component, Components...>::value; }
+
+	// Calls fn(container) for every container in the registry
+	template <typename Fn>
+	void for_each_container(Fn fn) { for_each_container(fn, std::index_sequence_for<Components...>()); }
+
+	// Bits of all components e has
+	ComponentMask mask_of(Entity e) const
+	{
+		return (alive(e) && e.index() < masks.size()) ? masks[e.index()] : 0;
+	}
+
+	// Query all entities that have each of the Queried components, see View
+	template <typename... Queried>
+	View<Queried...> view() { return View<Queried...>(container<Queried>()...); }
+
+	void clear_all_components() {
+		for_each_container([](auto& container) { container.clear(); });
+	}
+
+	void list_all_components() {
+		printf("Debug info on all registry entries:\n");
+		for_each_container([](auto& container) {
+			if (container.size() > 0)
+				printf("%4d components of type %s\n", (int)container.size(), typeid(container).name());
+		});
+	}
+
+	// Stats of every container, in the order of Components
+	std::vector<ContainerStats> stats() {
+		return { named_stats<Components>()... };
+	}
+
+	// Starts the operation counts of all containers over
+	void reset_stats() {
+		for_each_container([](auto& container) { container.reset_stats(); });
+	}
+
+	// Writes the entity pool and stats() as a JSON object, containers sorted by bytes, largest first
+	void write_stats_json(FILE* out) {
+		std::vector<ContainerStats> all = stats();
+		std::sort(all.begin(), all.end(), [](const ContainerStats& a, const ContainerStats& b) { return a.bytes > b.bytes; });
+		size_t total = masks.capacity() * sizeof(ComponentMask);
+		for (const ContainerStats& s : all)
+			total += s.bytes;
+
+		fprintf(out, "{\n\t\"entities\": { \"capacity\": %zu, \"free\": %zu, \"mask_bytes\": %zu },\n",
+			Entity::pool.capacity(), Entity::pool.free_count(), masks.capacity() * sizeof(ComponentMask));
+		fprintf(out, "\t\"total_bytes\": %zu,\n\t\"containers\": [", total);
+		for (size_t i = 0; i < all.size(); i++)
+		{
+			const ContainerStats& s = all[i];
+			fprintf(out, "%s\n\t\t{ \"name\": \"%s\", \"size\": %zu, \"capacity\": %zu, \"bytes\": %zu, \"index_load\": %.3f, "
+				"\"gets\": %llu, \"has\": %llu, \"inserts\": %llu, \"removes\": %llu }",
+				i > 0 ? "," : "", s.name.c_str(), s.size, s.capacity, s.bytes, s.index_load, s.gets, s.has, s.inserts, s.removes);
+		}
+		fprintf(out, "\n\t]\n}\n");
+	}
+
+	void list_all_components_of(Entity e) {
+		printf("Debug info on components of entity %u:\n", (unsigned int)e);
+		for_each_container([&](auto& container) {
+			if (container.has(e))
+				printf("type %s\n", typeid(container).name());
+		});
+	}
+
+	void remove_all_components_of(Entity e) {
+		static const Remover removers[] = { &remove_component<Components>... };
+		ComponentMask mask = mask_of(e);
+		while (mask)
+		{
+			removers[lowest_bit(mask)](*this, e);
+			mask &= mask - 1;
+		}
+	}
+
+	// Removes all components of e and recycles its index, any handle to e becomes stale
+	void destroy(Entity e) {
+		remove_all_components_of(e);
+		Entity::pool.release(e);
+	}
+
+	// Makes room for count more entities in the pool and the masks, see also the containers' reserve()
+	void reserve_entities(size_t count) {
+		Entity::pool.reserve(count);
+		masks.reserve(Entity::pool.capacity() + count);
+	}
+
+	// O(1) check whether e has not been destroyed yet
+	bool alive(Entity e) const {
+		return Entity::pool.alive(e);
+	}
+
+	// Entities created from now on belong to the level and are torn down by destroy_level_scope()
+	void begin_level_scope() {
+		Entity::pool.open_scope();
+	}
+
+	// Destroys all entities created since begin_level_scope(), entities created before stay untouched.
+	// Containers that hold nothing but level entities are cleared wholesale, only the ones shared with
+	// persistent entities (e.g. the trackball or the screen state) remove the level entities one by one.
+	void destroy_level_scope() {
+		std::vector<Entity> level;
+		for (unsigned int id : Entity::pool.close_scope())
+			if (Entity::pool.alive(id))
+				level.push_back(Entity::from_id(id));
+
+		size_t level_components[sizeof...(Components)] = {};
+		for (Entity e : level)
+			for (ComponentMask mask = mask_of(e); mask; mask &= mask - 1)
+				level_components[lowest_bit(mask)]++;
+
+		unsigned int bit = 0;
+		for_each_container([&](auto& container) {
+			if (level_components[bit] > 0 && level_components[bit] == container.size())
+				container.clear();
+			bit++;
+		});
+
+		// remove what is left in the shared containers and recycle the ids
+		for (Entity e : level)
+			destroy(e);
+	}
+
+	// Appends the EntityPool, the entity masks and every container but the Excluded ones to a snapshot buffer,
+	// see restore_snapshot. All component types must be trivially copyable.
+	template <typename... Excluded>
+	void save_snapshot(std::vector<char>& snapshot)
+	{
+		const ComponentMask excluded = mask_of_all<Excluded...>();
+		Entity::pool.save(snapshot);
+		snapshot_write(snapshot, masks);
+		unsigned int bit = 0;
+		for_each_container([&](auto& container) {
+			if (!(excluded & (ComponentMask(1) << bit++)))
+				container.save_snapshot(snapshot);
+		});
+	}
+
+	// Brings the registry back to the state of save_snapshot<Excluded...>() with bulk copies. Entities created since
+	// then are gone and their handles stale, the Excluded containers keep their current contents.
+	// in points at what save_snapshot appended and is advanced past it, the Excluded types have to be the same.
+	// Pending commands are dropped.
+	template <typename... Excluded>
+	void restore_snapshot(const char*& in)
+	{
+		const ComponentMask excluded = mask_of_all<Excluded...>();
+		commands.clear();
+		Entity::pool.load(in);
+
+		std::vector<ComponentMask> saved_masks;
+		snapshot_read(in, saved_masks);
+		saved_masks.resize(std::max(saved_masks.size(), masks.size()), 0);
+		for (size_t i = 0; i < masks.size(); i++)
+			saved_masks[i] = (saved_masks[i] & ~excluded) | (masks[i] & excluded);
+		masks.swap(saved_masks);
+
+		unsigned int bit = 0;
+		for_each_container([&](auto& container) {
+			if (!(excluded & (ComponentMask(1) << bit++)))
+				container.restore_snapshot(in);
+		});
+	}
+
+private:
+	template <typename Component>
+	ContainerStats named_stats()
+	{
+		ContainerStats stats = container<Component>().stats();
+		stats.name = type_name(typeid(Component));
+		return stats;
+	}
+
+	template <typename... Queried>
+	static ComponentMask mask_of_all()
+	{
+		ComponentMask mask = 0;
+		int expand[] = { 0, (mask |= mask_of<Queried>(), 0)... };
+		(void)expand;
+		return mask;
 	}
 };
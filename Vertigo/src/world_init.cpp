@@ -5,7 +5,7 @@ Entity createExplorer(RenderSystem* renderer, Coordinates pos, glm::mat4 transla
 	auto entity = Entity();
 
 	// Setting initial motion values
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.interpolate = true;
 	motion.position = vec3(0, 0, 0.5f);
 	motion.destination = vec3(0, 0, 0.5f);
@@ -118,7 +118,7 @@ void createRestartText(RenderSystem* renderer) {
 	Menu& menu = registry.menus.emplace(entity);
 
 	// Initialize the motion
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.position = vec3(0.6, -0.85, 1);
 	motion.scale = vec3(0.8, -0.2, 1);
 
@@ -140,7 +140,7 @@ Entity createTrackBallText(RenderSystem* renderer) {
 	registry.menus.emplace(entity);
 
 	// Initialize the motion
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.position = vec3(-0.5, -0.95, 1);
 	motion.scale = vec3(1.0, -0.1, 1);
 
@@ -166,7 +166,7 @@ void createInstructionsText(RenderSystem* renderer) {
 	Menu& menu = registry.menus.emplace(entity);
 
 	// Initialize the motion
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.position = vec3(0.8, 0.8, 1);
 	motion.scale = vec3(0.4, -0.4, 1);
 
@@ -297,7 +297,7 @@ Entity createDevice(RenderSystem* renderer, Coordinates pos, glm::mat4 translate
 
 	o.amplitude = o.center;
 
-	Motion& motion = registry.motions.get(entity);
+	MotionRef motion = registry.motions.get(entity);
 	motion.rotation = rand() % 10 + 1;
 
 	return entity;
@@ -330,7 +330,7 @@ Entity createBurnable(RenderSystem* renderer, Coordinates pos, glm::mat4 transla
 void createConstMovingTile(Entity entity, Coordinates pos, glm::mat4 translateMatrix) {
 	
 	// Setting initial motion values
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.interpolate = false;
 	motion.position = vec3(0, 0, 0);
 	motion.destination = vec3(0, 0, 0);
@@ -342,7 +342,7 @@ void createConstMovingTile(Entity entity, Coordinates pos, glm::mat4 translateMa
 
 void createThrowTile(Entity entity, Coordinates pos, glm::mat4 translateMatrix) {
 
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.interpolate = false;
 	motion.position = vec3(0, 0, 0);
 	motion.destination = vec3(0, 0, 0);
@@ -352,7 +352,7 @@ void createThrowTile(Entity entity, Coordinates pos, glm::mat4 translateMatrix)
 
 void createButtonTile(Entity entity, float length){
 	// Setting initial motion values
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.interpolate = false;
 	motion.position = vec3(0, 0, 0);
 	motion.destination = vec3(0, 0, 0);
@@ -397,7 +397,7 @@ void createObject(Entity entity, Coordinates pos, glm::mat4 translateMatrix, boo
 
 	if (hasMotion) {
 		// Setting initial motion values
-		Motion& motion = registry.motions.emplace(entity);
+		MotionRef motion = registry.motions.emplace(entity);
 		motion.interpolate = false;
 		motion.position = vec3(object.model[0][3], object.model[1][3], object.model[2][3]);
 		motion.destination = vec3(0, 0, 0);
@@ -411,6 +411,7 @@ void createLight(RenderSystem* renderer, Coordinates pos, glm::mat4 translateMat
 
 	Billboard& billboard = registry.billboards.emplace(entity);
 	billboard.model = translateMatrix * billboard.model;
+	billboard.face = pos.f;
 	switch (pos.f) {
 		case 0:
 			billboard.model = translate(glm::mat4(1.0f), vec3(0.f, 0.f, 1.5f)) * billboard.model;
@@ -478,7 +479,7 @@ Entity createCutscene(RenderSystem* renderer, GLuint texture_id) {
 	menu.auto_texture_id = true;
 
 	// Initialize the motion
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.position = vec3(0, 0, 1);
 	motion.scale = vec3(2, -2, 1);
 
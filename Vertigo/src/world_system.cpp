@@ -157,9 +157,10 @@ void WorldSystem::init(RenderSystem* renderer_arg) {
 	// Playing background music indefinitely
 	Mix_PlayMusic(background_music, -1);
 
-	// create TrackBall
+	// create TrackBall, the cube's root transform goes with it
 	auto entity = Entity();
 	registry.trackBall.emplace(entity);
+	registry.cubeRoot.emplace(entity);
 	float sphereRadius;
 	if (window_width_px > window_height_px)
 		sphereRadius = window_height_px * radius_scale;
@@ -210,7 +211,6 @@ void WorldSystem::play_intro(){
 	gameState = GameState::CUTSCENE;
 	
 	Entity scene = createCutscene(renderer, texture[0]);
-	RenderRequest& r = registry.renderRequests.get(scene);
 
 	using Clock = std::chrono::high_resolution_clock;
 	auto t = Clock::now();
@@ -224,13 +224,14 @@ void WorldSystem::play_intro(){
 		elapsed_ms += (float)(std::chrono::duration_cast<std::chrono::microseconds>(now - t)).count() / 1000;
 		t = now;
 		if (elapsed_ms > 100){
-			r.used_texture = (TEXTURE_ASSET_ID) texture[i];
+			// fetched every frame, the renderer re-sorts the render requests when drawing
+			registry.renderRequests.get(scene).used_texture = (TEXTURE_ASSET_ID) texture[i];
 			renderer->draw();
 			elapsed_ms -= 100;
 			i++;
 		}
 	}
-	registry.remove_all_components_of(scene);
+	registry.destroy(scene);
 }
 
 void WorldSystem::initLevelStatus() {
@@ -256,6 +257,8 @@ void WorldSystem::initLevelStatus() {
 
 // Update our game world
 bool WorldSystem::step(float elapsed_ms_since_last_update) {
+	hold_timers_due = false;
+
 	// TODO Update checking of out of screen
 	// Removing out of screen entities
 	auto& motions_registry = registry.motions;
@@ -273,9 +276,8 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 		}
 		// restart the game once the death timer expired
 		if (counter.counter_ms < 0) {
-			registry.restartTimer.remove(e);
+			registry.commands.remove<RestartTimer>(e);
 			screen.darken_screen_factor = 0;
-            cube.reset();
 			faceDirection = Direction::UP;
 			rot.status = BOX_ANIMATION::STILL;
 			TrackBallInfo& trackball = registry.trackBall.components[0];
@@ -309,7 +311,7 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 
 	rotateAll(elapsed_ms_since_last_update);
 
-	Motion& player_motion = motions_registry.get(player_explorer);
+	MotionRef player_motion = motions_registry.get(player_explorer);
 	// Update fire position
 
 	if (registry.fire.has(fire)){
@@ -317,7 +319,7 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 
 		if (motions_registry.has(fire) && fire_component.active == true){
 			Object& fire_object = registry.objects.get(fire);
-			Motion& fire_motion = motions_registry.get(fire);
+			MotionRef fire_motion = motions_registry.get(fire);
 			Player& player = registry.players.get(player_explorer);
 			if (fire_motion.position.z <= 0){
 				fire_motion.acceleration = vec3({0, 0, 0});
@@ -331,56 +333,19 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 		}
 	}
 	
-	for (Entity entity : registry.holdTimers.entities) {
-		// progress timer
-		HoldTimer& counter = registry.holdTimers.get(entity);
-		Motion& timer_motion = registry.motions.get(entity);
-
-		if (counter.increasing){
-			counter.counter_ms += elapsed_ms_since_last_update;
-			if (counter.counter_ms > counter.max_ms) {
-				if (counter.reverse_when_max){
-					counter.counter_ms = 2 * counter.max_ms - counter.counter_ms;
-					counter.increasing = false;
-				}
-				else{
-					counter.counter_ms = counter.max_ms;
-				}
-			}
-		}
-
-		else{
-			counter.counter_ms -= elapsed_ms_since_last_update;
-			if (counter.counter_ms < 0) {
-				if (counter.reverse_when_max){
-					counter.counter_ms = -counter.counter_ms;
-					counter.increasing = true;
-				}
-				else{
-					counter.counter_ms = 0;
-				}
-			}
-		}
-
-		timer_motion.scale.z = counter.counter_ms/counter.max_ms;
-		timer_motion.position.y = timer_motion.scale.z / 2 + player_motion.position.y;
-		timer_motion.position.z = player_motion.position.z + 1;
-	}
-
 	// handle animations here
-	for (Entity entity : registry.animated.entities) {
-
-		Animated& counter = registry.animated.get(entity);
+	registry.view<Animated, Tile*>().each([&](Entity entity, Animated& counter, Tile* tile) {
 		if (counter.activate == true){
 			counter.counter_ms += elapsed_ms_since_last_update;
 		}
 
 		if (counter.counter_ms > counter.max_ms) {
-			registry.animated.remove(entity);
-			Tile* tile = registry.tiles.get(entity);
+			// the removal waits for the sync point, the view keeps iterating the dense arrays meanwhile
+			registry.commands.remove<Animated>(entity);
 			tile->tileState = TileState::V;
+			registry.tiles.mark_dirty(entity);
 		}
-	}
+	});
 
 	if (gameState == GameState::BURNING) {
 		
@@ -393,6 +358,7 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 			Coordinates newCoords = searchForTile(trueDirection, tile->coords);
 			Tile* btile = cube.getTile(newCoords);
 			btile->tileState = TileState::V;
+			markTileChanged(btile);
 		}
 	}
 
@@ -443,176 +409,175 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 		}
 	}
 
-	for (Entity entity : registry.oscillations.entities) {
-
-		if (!registry.objects.has(entity)) {
-			continue;
-		}
-
-		Object& device = registry.objects.get(entity);
-		Motion& motion = registry.motions.get(entity);
+	registry.view<Oscillate, Object, Motion>().each([](Entity, Oscillate&, Object& device, MotionRef motion) {
 		device.model = device.model * rotate(glm::mat4(1.0f), radians(motion.rotation), vec3(0,1,0));
-	}
+	});
 
+	// the hold timers are their own system, see update_hold_timers(), they only run after a complete step
+	hold_timers_due = true;
 	return true;
 }
 
-void WorldSystem::rotateAll(float elapsed_ms_since_last_update) {
+void WorldSystem::update_hold_timers(float elapsed_ms_since_last_update) {
+	if (!hold_timers_due)
+		return;
 
-	glm::mat4 model = glm::mat4(1.f);
+	const vec3 player_position = registry.motions.read(player_explorer).position;
+	registry.view<HoldTimer, Motion>().each([&](Entity entity, HoldTimer& counter, MotionRef timer_motion) {
+		// progress timer
 
-	if (rot.status == BOX_ANIMATION::STILL) return;
-		float rads;
-		if (elapsed_ms_since_last_update > rot.remainingTime) {
-			rads = radians((90.f / rot.animationTime) * rot.remainingTime);
-			rot.remainingTime = 0.f;
-		} else {
-			rads = radians((90.f / rot.animationTime) * elapsed_ms_since_last_update);
-			rot.remainingTime -= elapsed_ms_since_last_update;
+		if (counter.increasing){
+			counter.counter_ms += elapsed_ms_since_last_update;
+			if (counter.counter_ms > counter.max_ms) {
+				if (counter.reverse_when_max){
+					counter.counter_ms = 2 * counter.max_ms - counter.counter_ms;
+					counter.increasing = false;
+				}
+				else{
+					counter.counter_ms = counter.max_ms;
+				}
+			}
 		}
 
-	for (Tile* tile : registry.tiles.components) {
-		switch (rot.status) {
-		case BOX_ANIMATION::UP:
-			tile->model = rotate(glm::mat4(1.0f), -rads, vec3(1.0f, 0.0f, 0.0f)) * tile->model;
-			break;
-		case BOX_ANIMATION::DOWN:
-			tile->model = rotate(glm::mat4(1.0f), rads, vec3(1.0f, 0.0f, 0.0f)) * tile->model;
-			break;
-		case BOX_ANIMATION::LEFT:
-			tile->model = rotate(glm::mat4(1.0f), -rads, vec3(0.0f, 1.0f, 0.0f)) * tile->model;
-			break;
-		case BOX_ANIMATION::RIGHT:
-			tile->model = rotate(glm::mat4(1.0f), rads, vec3(0.0f, 1.0f, 0.0f)) * tile->model;
-			break;
-		default:
-			break;
+		else{
+			counter.counter_ms -= elapsed_ms_since_last_update;
+			if (counter.counter_ms < 0) {
+				if (counter.reverse_when_max){
+					counter.counter_ms = -counter.counter_ms;
+					counter.increasing = true;
+				}
+				else{
+					counter.counter_ms = 0;
+				}
+			}
 		}
-	}
-
-	for (Text& text : registry.text.components) {
 
-		switch (rot.status) {
-		case BOX_ANIMATION::UP:
-			text.model = rotate(glm::mat4(1.0f), -rads, vec3(1.0f, 0.0f, 0.0f)) * text.model;
-			break;
-		case BOX_ANIMATION::DOWN:
-			text.model = rotate(glm::mat4(1.0f), rads, vec3(1.0f, 0.0f, 0.0f)) * text.model;
-			break;
-		case BOX_ANIMATION::LEFT:
-			text.model = rotate(glm::mat4(1.0f), -rads, vec3(0.0f, 1.0f, 0.0f)) * text.model;
-			break;
-		case BOX_ANIMATION::RIGHT:
-			text.model = rotate(glm::mat4(1.0f), rads, vec3(0.0f, 1.0f, 0.0f)) * text.model;
-			break;
-		}
-	}
+		timer_motion.scale.z = counter.counter_ms/counter.max_ms;
+		timer_motion.position.y = timer_motion.scale.z / 2 + player_position.y;
+		timer_motion.position.z = player_position.z + 1;
+		registry.motions.mark_dirty(entity);
+	});
+}
 
-	for (Object& object : registry.objects.components) {
+void WorldSystem::rotateAll(float elapsed_ms_since_last_update) {
 
-		switch (rot.status) {
-		case BOX_ANIMATION::UP:
-			object.model = rotate(glm::mat4(1.0f), -rads, vec3(1.0f, 0.0f, 0.0f)) * object.model;
-			break;
-		case BOX_ANIMATION::DOWN:
-			object.model = rotate(glm::mat4(1.0f), rads, vec3(1.0f, 0.0f, 0.0f)) * object.model;
-			break;
-		case BOX_ANIMATION::LEFT:
-			object.model = rotate(glm::mat4(1.0f), -rads, vec3(0.0f, 1.0f, 0.0f)) * object.model;
-			break;
-		case BOX_ANIMATION::RIGHT:
-			object.model = rotate(glm::mat4(1.0f), rads, vec3(0.0f, 1.0f, 0.0f)) * object.model;
-			break;
-		}
+	// While animating only the cube root turns, by the angle of the time passed so far. A turn that was stopped
+	// (next level, restart) is dropped, the models never got it.
+	CubeRoot& root = registry.cubeRoot.components[0];
+	if (rot.status == BOX_ANIMATION::STILL) {
+		root.animation = quat(1,0,0,0);
+		return;
 	}
+	rot.remainingTime = max(0.f, rot.remainingTime - elapsed_ms_since_last_update);
 
-	for (Oscillate& oscillate : registry.oscillations.components){
-		switch (rot.status) {
-		case BOX_ANIMATION::UP:
-			oscillate.amplitude = rotate(glm::mat4(1.0f), -rads, vec3(1.0f, 0.0f, 0.0f)) * vec4(oscillate.amplitude, 0);
-			oscillate.center = oscillate.amplitude;
-			break;
-		case BOX_ANIMATION::DOWN:
-			oscillate.amplitude = rotate(glm::mat4(1.0f), rads, vec3(1.0f, 0.0f, 0.0f)) * vec4(oscillate.amplitude, 0);
-			oscillate.center = oscillate.amplitude;
-			break;
-		case BOX_ANIMATION::LEFT:
-			oscillate.amplitude = rotate(glm::mat4(1.0f), -rads, vec3(0.0f, 1.0f, 0.0f)) * vec4(oscillate.amplitude, 0);
-			oscillate.center = oscillate.amplitude;
-			break;
-		case BOX_ANIMATION::RIGHT:
-			oscillate.amplitude = rotate(glm::mat4(1.0f), rads, vec3(0.0f, 1.0f, 0.0f)) * vec4(oscillate.amplitude, 0);
-			oscillate.center = oscillate.amplitude;
-			break;
-		}
+	// the quarter turn of the animation
+	vec3 axis = vec3(1.0f, 0.0f, 0.0f);
+	float sign = 1.f;
+	switch (rot.status) {
+	case BOX_ANIMATION::UP:
+		sign = -1.f;
+		break;
+	case BOX_ANIMATION::DOWN:
+		break;
+	case BOX_ANIMATION::LEFT:
+		axis = vec3(0.0f, 1.0f, 0.0f);
+		sign = -1.f;
+		break;
+	case BOX_ANIMATION::RIGHT:
+		axis = vec3(0.0f, 1.0f, 0.0f);
+		break;
+	default:
+		break;
 	}
 
-	for (Billboard& billboard: registry.billboards.components) {
-		switch (rot.status) {
-		case BOX_ANIMATION::UP:
-			billboard.model = rotate(glm::mat4(1.0f), -rads, vec3(1.0f, 0.0f, 0.0f)) * billboard.model;
-			break;
-		case BOX_ANIMATION::DOWN:
-			billboard.model = rotate(glm::mat4(1.0f), rads, vec3(1.0f, 0.0f, 0.0f)) * billboard.model;
-			break;
-		case BOX_ANIMATION::LEFT:
-			billboard.model = rotate(glm::mat4(1.0f), -rads, vec3(0.0f, 1.0f, 0.0f)) * billboard.model;
-			break;
-		case BOX_ANIMATION::RIGHT:
-			billboard.model = rotate(glm::mat4(1.0f), rads, vec3(0.0f, 1.0f, 0.0f)) * billboard.model;
-			break;
-		}
+	if (rot.remainingTime > 0.f) {
+		const float progress = 1.f - rot.remainingTime / rot.animationTime;
+		root.animation = angleAxis(sign * radians(90.f) * progress, axis);
+		return;
 	}
+	root.animation = quat(1,0,0,0);
 
-	// TODO: rotate all objects that are rendered on screen
-	if (rot.remainingTime == 0.f)
-	{
-		rot.status = BOX_ANIMATION::STILL;
-	}
+	// At the end the quarter turn goes into the models. Its entries are exactly 0 and +-1, so turning over and
+	// over doesn't accumulate any error.
+	glm::mat4 rotation = rotate(glm::mat4(1.0f), sign * radians(90.f), axis);
+	for (int column = 0; column < 4; column++)
+		rotation[column] = round(rotation[column]);
+
+	// Every component is transformed on its own, so the containers are split across the workers
+	registry.tiles.parallel_for_each([&](Entity, Tile* tile) {
+		tile->model = rotation * tile->model;
+	}, 256);
+
+	registry.text.parallel_for_each([&](Entity, Text& text) {
+		text.model = rotation * text.model;
+	}, 256);
+
+	registry.objects.parallel_for_each([&](Entity, Object& object) {
+		object.model = rotation * object.model;
+	}, 256);
+
+	registry.oscillations.parallel_for_each([&](Entity, Oscillate& oscillate) {
+		oscillate.amplitude = rotation * vec4(oscillate.amplitude, 0);
+		oscillate.center = oscillate.amplitude;
+	}, 256);
+
+	// marks the billboards as changed, so that the renderer knows the lights moved
+	registry.billboards.parallel_for_each([&](Entity, Billboard& billboard) {
+		billboard.model = rotation * billboard.model;
+	}, 256);
+
+	rot.status = BOX_ANIMATION::STILL;
 }
 
 bool WorldSystem::enemyOnTile(Coordinates coordinates)
 {
-	for (Entity entity : registry.enemies.entities) {
-		Object& obj = registry.objects.get(entity);
-		if (obj.objectPos.equal(coordinates)) return true;
-	}
-	return false;
+	bool found = false;
+	registry.view<Enemy, Object>().each([&](Entity, Enemy&, Object& obj) {
+		found |= obj.objectPos.equal(coordinates);
+	});
+	return found;
 }
 
 // Reset the world state to its initial state
 void WorldSystem::restart_game() {
-	// Debugging for memory/component leaks
-	registry.list_all_components();
 	printf("Restarting\n");
 
-	// Remove all entities that we created
-	// All that have a motion, we could also iterate over all bug, eagles, ... but that would be more cumbersome
-	while (registry.motions.entities.size() > 0)
-		registry.remove_all_components_of(registry.motions.entities.back());
-
-	while (registry.tiles.entities.size() > 0)
-		registry.remove_all_components_of(registry.tiles.entities.back());
-
-	while (registry.text.entities.size() > 0)
-		registry.remove_all_components_of(registry.text.entities.back());
-
-	while (registry.objects.entities.size() > 0)
-		registry.remove_all_components_of(registry.objects.entities.back());
-
-	while (registry.renderRequests.entities.size() > 0)
-		registry.remove_all_components_of(registry.renderRequests.entities.back());
+	// a turn of the cube that was cut short is dropped
+	for (CubeRoot& root : registry.cubeRoot.components)
+		root.animation = quat(1,0,0,0);
 
+	// The level select buttons are persistent entities (see levels), only strip their components
 	while (registry.menuButtons.entities.size() > 0)
 		registry.remove_all_components_of(registry.menuButtons.entities.back());
 
-	while (registry.menus.entities.size() > 0)
-		registry.remove_all_components_of(registry.menus.entities.back());
-
-	load_level();
+	if (snapshot_level == level) {
+		// Same level again, roll back to the state right after it was loaded
+		const char* in = level_snapshot.data();
+		registry.restore_snapshot<TrackBallInfo, CubeRoot, ScreenState>(in);
+		cube.load_tiles(in);
+		snapshot_read(in, player_explorer);
+		snapshot_read(in, fire);
+		snapshot_read(in, trackBallText);
+	}
+	else {
+		// Remove all entities that the previous level created, this includes everything created while playing it
+		// (fire gauges, restart texts, ...). The trackball and the screen state were created before and stay.
+		registry.destroy_level_scope();
+		registry.begin_level_scope();
 
-	// Debugging for memory/component leaks
-	registry.list_all_components();
+		cube.reset();
+		load_level();
+
+		// Keep the loaded state for restarts, the trackball and the screen state aren't part of the level
+		level_snapshot.clear();
+		registry.save_snapshot<TrackBallInfo, CubeRoot, ScreenState>(level_snapshot);
+		cube.save_tiles(level_snapshot);
+		snapshot_write(level_snapshot, player_explorer);
+		snapshot_write(level_snapshot, fire);
+		snapshot_write(level_snapshot, trackBallText);
+		snapshot_level = level;
+	}
+	start_level();
 }
 
 void WorldSystem::load_level() {
@@ -622,6 +587,9 @@ void WorldSystem::load_level() {
 	// Load a level
 	cube.loadFromExcelFile(tile_path("level" + std::to_string(level) + ".csv"));
 	cube.createAdjList();
+	cube.loadTextFromExcelFile(text_path("text" + std::to_string(level) + ".csv"));
+	reserve_for_level();
+
 	for (int i = 0; i < 6; i++) {
 		for (int j = 0; j < cube.size; j++) {
 			for (int k = 0; k < cube.size; k++) {
@@ -681,7 +649,6 @@ void WorldSystem::load_level() {
 		}
 	}
 
-	cube.loadTextFromExcelFile(text_path("text" + std::to_string(level) + ".csv"));
 	for (uint i = 0; i < cube.text.size(); i++) {
 		createText(cube.text[i]);
 	}
@@ -691,22 +658,6 @@ void WorldSystem::load_level() {
 
 	cube.loadModificationsFromExcelFile(modifications_path("modifications" + std::to_string(level) + ".csv"));
 
-	// Update button tiles
-
-	for (uint i = 0; i < registry.buttons.size(); i++) {
-		Entity e = registry.buttons.entities[i];
-		Tile* tile = registry.tiles.get(e);
-		ButtonTile* b = (ButtonTile*)cube.getTile(tile->coords);
-		RenderRequest& r = registry.renderRequests.get(e);
-
-		if (b->button_id == (int)BUTTON::SOUND) {
-			r.used_texture = (TEXTURE_ASSET_ID)((int)TEXTURE_ASSET_ID::BUTTON_SOUND_OFF + sound_on);
-		}
-		else {
-			r.used_texture = (TEXTURE_ASSET_ID)((int)TEXTURE_ASSET_ID::BUTTON_START + b->button_id);
-		}
-	}
-
 	// Update constantly moving tiles
 	for (uint i = 0; i < registry.oscillations.size(); i++) {
 		Entity e = registry.oscillations.entities[i];
@@ -768,6 +719,57 @@ void WorldSystem::load_level() {
 	// Create a new explorer
 	player_explorer = createExplorer(renderer, startingpos, translateMatrix);
 	registry.colors.insert(player_explorer, { 1, 1, 1 });
+}
+
+// Reserves the containers for the entities load_level() is about to create, from the tiles of the loaded cube.
+// The counts follow the create functions in world_init.cpp, too much only costs a little memory.
+void WorldSystem::reserve_for_level() {
+	size_t states[26] = {};
+	for (const auto& face : cube.faces)
+		for (const auto& row : face)
+			for (const Tile* tile : row)
+				states[(int)tile->tileState]++;
+	auto count = [&](TileState state) { return states[(int)state]; };
+
+	const size_t tiles = 6 * cube.size * cube.size;
+	const size_t columns = count(TileState::N);
+	const size_t devices = count(TileState::W) + count(TileState::T);
+	const size_t objects = columns + count(TileState::B) + count(TileState::F) + devices + count(TileState::A);
+	const size_t overlays = 5; // explorer, fire gauge and the menu texts
+	const size_t entities = tiles + objects + columns + cube.text.size() + overlays;
+
+	registry.reserve_entities(entities);
+	registry.tiles.reserve(tiles);
+	registry.renderRequests.reserve(entities);
+	registry.objects.reserve(objects);
+	registry.meshPtrs.reserve(objects + overlays);
+	registry.motions.reserve(objects + count(TileState::O) + count(TileState::T) + count(TileState::G) + overlays);
+	registry.oscillations.reserve(count(TileState::O) + devices);
+	registry.billboards.reserve(columns);
+	registry.lightSources.reserve(columns + count(TileState::F));
+	registry.burnables.reserve(count(TileState::B));
+	registry.enemies.reserve(count(TileState::A));
+	registry.buttons.reserve(count(TileState::G));
+	registry.text.reserve(cube.text.size());
+}
+
+// Puts a loaded or restored level into its starting state
+void WorldSystem::start_level() {
+	// Update button tiles
+
+	for (uint i = 0; i < registry.buttons.size(); i++) {
+		Entity e = registry.buttons.entities[i];
+		Tile* tile = registry.tiles.get(e);
+		ButtonTile* b = (ButtonTile*)cube.getTile(tile->coords);
+		RenderRequest& r = registry.renderRequests.get(e);
+
+		if (b->button_id == (int)BUTTON::SOUND) {
+			r.used_texture = (TEXTURE_ASSET_ID)((int)TEXTURE_ASSET_ID::BUTTON_SOUND_OFF + sound_on);
+		}
+		else {
+			r.used_texture = (TEXTURE_ASSET_ID)((int)TEXTURE_ASSET_ID::BUTTON_START + b->button_id);
+		}
+	}
 
 	obtainedFire = false;
 	faceDirection = Direction::UP;
@@ -777,13 +779,15 @@ void WorldSystem::load_level() {
 
 // Compute collisions between entities
 void WorldSystem::handle_collisions() {
+	// Take the collisions the physics system detected this step, the ones of the previous step are dropped
+	registry.collision_events.swap();
+
 	// Loop over all collisions detected by the physics system
 	if (gameState == GameState::MENU) return;
-	auto& collisionsRegistry = registry.collisions; // TODO: @Tim, is the reference here needed?
-	for (uint i = 0; i < collisionsRegistry.components.size(); i++) {
+	for (const CollisionEvent& collision : registry.collision_events) {
 		// The entity and its collider
-		Entity entity = collisionsRegistry.entities[i];
-		Entity entity_other = collisionsRegistry.components[i].other;
+		Entity entity = collision.first;
+		Entity entity_other = collision.other;
 
 		if (registry.fire.has(entity) && registry.objects.has(entity_other)){
 			Object& object = registry.objects.get(entity_other);
@@ -798,9 +802,6 @@ void WorldSystem::handle_collisions() {
 			}
 		}
 	}
-
-	// Remove all collisions from this simulation step
-	registry.collisions.clear();
 }
 
 // Should the game be over ?
@@ -819,6 +820,27 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
 		return;
 	}
 
+	// ECS statistics: F1 dumps them as JSON, F2 starts the operation counts over
+	if (action == GLFW_RELEASE && key == GLFW_KEY_F1) {
+		registry.write_stats_json(stdout);
+		return;
+	}
+	if (action == GLFW_RELEASE && key == GLFW_KEY_F2) {
+		registry.reset_stats();
+		return;
+	}
+	// Draw calls and state changes of the last frame
+	if (action == GLFW_RELEASE && key == GLFW_KEY_F3) {
+		renderer->renderStats().write_json(stdout);
+		return;
+	}
+	// Time spent in the systems, printed every few seconds while on
+	if (action == GLFW_RELEASE && key == GLFW_KEY_F4) {
+		report_system_timings = !report_system_timings;
+		printf("System timings %s\n", report_system_timings ? "on" : "off");
+		return;
+	}
+
 	if (gameState != GameState::IDLE && gameState != GameState::TITLE_SCREEN && gameState != GameState::MENU) {
 		return;
 	}
@@ -941,7 +963,7 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
 		if (action == GLFW_RELEASE && key == GLFW_KEY_ENTER && registry.holdTimers.has(fire_gauge) && gameState != GameState::MENU) {
 			HoldTimer& holdTimer = registry.holdTimers.get(fire_gauge);
 			float power = holdTimer.counter_ms / holdTimer.max_ms;
-			registry.remove_all_components_of(fire_gauge);
+			registry.destroy(fire_gauge);
 			UsePower(currDirection, power);
 		}
 
@@ -1045,6 +1067,8 @@ void WorldSystem::tile_move(Direction direction, SwitchTile* tile) {
 		controlTile->highlighted = false;
     	controlTile->color = -1;
 		controlTile->popup = false;
+		registry.tiles.mark_dirty(next_tile_entity);
+		registry.tiles.mark_dirty(cur_tile_entity);
 
 		tile->targetTile = new_ctile;
 	}
@@ -1055,7 +1079,7 @@ void WorldSystem::tile_move(Direction direction, SwitchTile* tile) {
 void WorldSystem::player_move(vec3 movement, Direction direction) 
 {
 	Player& player = registry.players.get(player_explorer);
-	Motion& motion = registry.motions.get(player_explorer);
+	MotionRef motion = registry.motions.get(player_explorer);
 	if (motion.position != motion.destination){
 		Mix_PlayChannel(-1, move_fail_sound, 0);
 		return;
@@ -1088,17 +1112,19 @@ void WorldSystem::player_move(vec3 movement, Direction direction)
 	Tile* currtile = cube.getTile(registry.players.get(player_explorer).playerPos);
 	if (currtile->tileState == TileState::G){
 		currtile->highlighted = false;
+		markTileChanged(currtile);
 	}
 
 	// Updates based on new tile
 	// Button
 	if (tile->tileState == TileState::G){
 		tile->highlighted = true;
+		markTileChanged(tile);
 	}
 	// Fire
 	if (tile->tileState == TileState::F){
 		Object& fire_object = registry.objects.get(fire);
-		Motion& fire_motion = registry.motions.get(fire);
+		MotionRef fire_motion = registry.motions.get(fire);
 		Fire& fire_component = registry.fire.get(fire);
 		fire_component.active = true;
 		fire_object.model = player.model;
@@ -1219,6 +1245,8 @@ void WorldSystem::player_move(vec3 movement, Direction direction)
 				motion.move_z = true;
 				break;
 		}
+		// the popups of the tiles follow their direction
+		registry.tiles.mark_all_dirty();
 
 	} else {
 		motion.move_z = false;
@@ -1311,6 +1339,7 @@ void WorldSystem::Interact(Tile* tile)
 		c_tile->controled = !c_tile->controled;
 		c_tile->highlighted = !c_tile->highlighted;
 		c_tile->popup = !c_tile->popup;
+		markTileChanged(c_tile);
 	}
 	else {
 
@@ -1351,6 +1380,8 @@ void WorldSystem::Interact(Tile* tile)
 			dest_request.used_texture = TEXTURE_ASSET_ID::MOVE_TILE;
 		}
 		src_tile->tileState = TileState::E;
+		registry.tiles.mark_dirty(src_tile_entity);
+		registry.tiles.mark_dirty(dest_tile_entity);
 	}
 
 	if (s_tile->tileState == TileState::O) {
@@ -1362,7 +1393,7 @@ void WorldSystem::Interact(Tile* tile)
 			registry.oscillations.remove(s_tile->device);
 			Object& device = registry.objects.get(s_tile->device);
 			device.color = vec3(0.5);
-			Motion& motion = registry.motions.get(s_tile->device);
+			MotionRef motion = registry.motions.get(s_tile->device);
 			motion.position = vec3(0, 0, 0.2);
 		}
 	}
@@ -1383,7 +1414,7 @@ void WorldSystem::UsePower(Direction direction, float power)
 
 	fire_component.inUse = true;
 
-	Motion& motion = registry.motions.get(fire);
+	MotionRef motion = registry.motions.get(fire);
 	float p = 3.0f;
 	motion.acceleration = vec3(0, 0, -2 * p);
 
@@ -1510,11 +1541,24 @@ Entity WorldSystem::getTileFromRegistry(Coordinates coordinates) {
 	return registry.tiles.entities.at(index);
 }
 
+// The tiles are changed through the cube's pointers instead of registry.tiles.get(), the renderer has to be told
+void WorldSystem::markTileChanged(const Tile* tile) {
+	const size_t index = (size_t)(cube.size * cube.size * tile->coords.f + cube.size * tile->coords.r + tile->coords.c);
+	if (index < registry.tiles.size() && registry.tiles.components[index] == tile) {
+		registry.tiles.mark_dirty_at((unsigned int)index);
+		return;
+	}
+	// not in the order of the cube, e.g. the level buttons
+	for (unsigned int i = 0; i < registry.tiles.size(); i++) {
+		if (registry.tiles.components[i] == tile)
+			registry.tiles.mark_dirty_at(i);
+	}
+}
+
 void WorldSystem::next_level() {
 	
 		int w, h;
 		glfwGetWindowSize(window, &w, &h);
-		cube.reset();
 		level = level == 20 ? 25 : (level + 1) % maxLevel;
 		faceDirection = Direction::UP;
 		gameState = GameState::IDLE;
@@ -49,6 +49,9 @@ public:
 	// Steps the game ahead by ms milliseconds
 	bool step(float elapsed_ms);
 
+	// Progresses the hold timers (the fire gauge), a separate pass of step() that only touches HoldTimer and Motion
+	void update_hold_timers(float elapsed_ms);
+
 	// Check for collisions
 	void handle_collisions();
 
@@ -57,6 +60,9 @@ public:
 
 	// Should the game be over ?
 	bool is_over()const;
+
+	// Whether the scheduler prints the time spent in every system, toggled with F4
+	bool report_system_timings = false;
 private:
 	// Input callback functions
 	void on_key(int key, int, int action, int mod);
@@ -87,6 +93,9 @@ private:
 	// Object Attributes
 	bool activated = false;
 
+	// Set by step() once it completed without restarting or leaving the level
+	bool hold_timers_due = false;
+
 	// trackball attributes
 	Trackball trackBallClass;
 	Entity trackBallText;
@@ -94,6 +103,8 @@ private:
 	// restart level
 	void restart_game();
 	void load_level();
+	void reserve_for_level();
+	void start_level();
 	void next_level();
 	void initLevelStatus();
 
@@ -103,6 +114,11 @@ private:
 	// Current level the player is on.
 	unsigned int level;
 
+	// The registry, the tiles and the level's entity handles right after loading snapshot_level,
+	// restarting that level restores them instead of loading it again
+	std::vector<char> level_snapshot;
+	unsigned int snapshot_level = ~0u;
+
 	// Game state
 	RenderSystem* renderer;
 	Entity player_explorer;
@@ -130,6 +146,7 @@ private:
 	Coordinates searchForTile(Direction direction, Coordinates coords);
 	Entity getCurrentTileEntity();
 	Entity getTileFromRegistry(Coordinates coordinates);
+	void markTileChanged(const Tile* tile);
 	void rotateAll(float elapsed_ms_since_last_update);
 	bool enemyOnTile(Coordinates coordinates);
 
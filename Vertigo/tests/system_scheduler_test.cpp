@@ -0,0 +1,75 @@
+// Checks that SystemScheduler runs the systems that need the main thread on the thread that calls run(), while
+// the others may go to the workers, and that conflicting systems keep their order.
+
+// stlib
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// internal
+#include "system_scheduler.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+int main()
+{
+	ThreadPool pool(3);
+	SystemScheduler scheduler(pool);
+	const std::thread::id main_thread = std::this_thread::get_id();
+
+	std::mutex mutex;
+	std::vector<std::thread::id> exclusive_threads;
+	std::vector<std::thread::id> main_thread_threads;
+	std::vector<int> order;
+	auto record = [&](std::vector<std::thread::id>& threads, int step) {
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.push_back(std::this_thread::get_id());
+		order.push_back(step);
+	};
+	std::vector<std::thread::id> worker_threads;
+
+	// the same shape as the game's frame: exclusive systems around systems that may run anywhere
+	scheduler.add("exclusive_first", SystemAccess::everything(), [&](float) { record(exclusive_threads, 0); });
+	for (int i = 0; i < 8; i++)
+	{
+		scheduler.add("worker", SystemAccess(), [&](float) {
+			// long enough that the idle workers pick some of them up
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			record(worker_threads, 1);
+		});
+	}
+	scheduler.add("main_thread", SystemAccess().on_main_thread(), [&](float) { record(main_thread_threads, 1); });
+	scheduler.add("exclusive_last", SystemAccess::everything(), [&](float) { record(exclusive_threads, 2); });
+
+	for (int frame = 0; frame < 50; frame++)
+	{
+		order.clear();
+		scheduler.run(16.f);
+		check(order.size() == 11, "every system ran once per frame");
+		check(!order.empty() && order.front() == 0 && order.back() == 2, "the exclusive systems keep their order around the others");
+	}
+
+	for (std::thread::id id : exclusive_threads)
+		check(id == main_thread, "exclusive systems run on the thread calling run()");
+	for (std::thread::id id : main_thread_threads)
+		check(id == main_thread, "main thread systems run on the thread calling run()");
+	bool on_workers = false;
+	for (std::thread::id id : worker_threads)
+		on_workers |= id != main_thread;
+	check(on_workers, "the other systems also run on the workers");
+
+	if (failures == 0)
+		printf("system_scheduler_test passed\n");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
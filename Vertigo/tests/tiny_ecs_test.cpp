@@ -0,0 +1,75 @@
+// Checks that clearing a container keeps the pages its SparseEntityIndex reserved, and that the cleared
+// container still answers has() and takes inserts without allocating new pages.
+
+// stlib
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// internal
+#include "tiny_ecs.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+struct Payload
+{
+	int value;
+};
+
+int main()
+{
+	const size_t count = 5000;
+
+	// The index on its own
+	SparseEntityIndex index;
+	index.reserve(count, count);
+	const size_t pages = index.allocated_pages();
+	check(pages > 0, "reserve allocates pages");
+	for (unsigned int id = 0; id < count; id++)
+		index.set(id, id);
+	index.clear();
+	check(index.allocated_pages() == pages, "clear keeps the reserved pages");
+	check(index.find(0) == SparseEntityIndex::npos && index.find(count - 1) == SparseEntityIndex::npos,
+		"clear resets the slots");
+	index.set(7, 3);
+	check(index.find(7) == 3, "set after clear");
+	check(index.allocated_pages() == pages, "set after clear allocates no pages");
+
+	// Through a container, as a level does when it is reloaded
+	std::vector<Entity> entities;
+	for (size_t i = 0; i < count; i++)
+		entities.push_back(Entity());
+	ComponentContainer<Payload> container;
+	container.reserve(count);
+	const size_t reserved_bytes = container.stats().bytes;
+	for (Entity entity : entities)
+		container.insert(entity, Payload{ (int)entity.index() });
+	container.clear();
+	check(container.size() == 0, "clear removes the components");
+	check(container.stats().bytes == reserved_bytes, "clear keeps the reserved memory");
+	bool any = false;
+	for (Entity entity : entities)
+		any = any || container.has(entity);
+	check(!any, "has() is false after clear");
+
+	for (Entity entity : entities)
+		container.insert(entity, Payload{ (int)entity.index() + 1 });
+	check(container.stats().bytes == reserved_bytes, "inserts after clear don't reallocate");
+	bool all = true;
+	for (Entity entity : entities)
+		all = all && container.has(entity) && container.read(entity).value == (int)entity.index() + 1;
+	check(all, "has() and read() after inserting again");
+
+	if (failures == 0)
+		printf("tiny_ecs_test passed\n");
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}